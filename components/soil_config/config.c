@@ -0,0 +1,134 @@
+#include "config.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <string.h>
+#include <stddef.h>
+#include "esp_log.h"
+
+static config_data_t config;
+static bool loaded = false;
+
+// === NEW: default sensati ===
+static void config_apply_defaults(config_data_t *c) 
+{
+    memset(c, 0, sizeof(*c));
+    // metti qui eventuali default esistenti che già usavi (SSID, host, ecc) se vuoi
+    c->mqtt_port = 1883;
+    c->sleep_minutes = 5;
+
+    // batteria tipica Li-Ion
+    c->batt_mv_min = DEFAULT_BATT_MV_MIN;
+    c->batt_mv_max = DEFAULT_BATT_MV_MAX;
+    c->vbat_scale_q16 = DEFAULT_VBAT_SCALE_Q16;
+    c->vbat_offset_mv = 0;
+    // ADC “tipici”: adatta ai tuoi (solo valori iniziali)
+    c->soil_wet_raw = 1200;
+    c->soil_dry_raw = 3200;
+
+    c->hist_period_h = 24;
+
+    c->e_radio_ua = DEFAULT_E_RADIO_UA;
+    c->e_cpu_ua = DEFAULT_E_CPU_UA;
+    c->e_probe_ua = DEFAULT_E_PROBE_UA;
+    c->e_sleep_ua = DEFAULT_E_SLEEP_UA;
+    c->batt_capacity_mah = DEFAULT_BATT_CAPACITY_MAH;
+
+    c->pol_stretch_mv = DEFAULT_POL_STRETCH_MV;
+    c->pol_crit_mv = DEFAULT_POL_CRIT_MV;
+    c->pol_max_factor = DEFAULT_POL_MAX_FACTOR;
+    c->pol_heartbeat_every = DEFAULT_POL_HEARTBEAT_EVERY;
+
+    c->trend_enabled = 0;
+    c->trend_min_minutes = DEFAULT_TREND_MIN_MINUTES;
+    c->trend_max_minutes = DEFAULT_TREND_MAX_MINUTES;
+    c->trend_deadband_pm = DEFAULT_TREND_DEADBAND_PM;
+    c->trend_threshold_pm = 0;
+
+    c->wake_slot_s = -1;
+    c->sntp_every = DEFAULT_SNTP_EVERY;
+    c->stub_skip = 0;
+    c->health_every = DEFAULT_HEALTH_EVERY;
+    c->disc_mode = DISC_MODE_ENTITY;
+
+    c->conn_mode = CONN_MODE_AUTO;
+    c->listen_interval = DEFAULT_LISTEN_INTERVAL;
+    c->e_conn_ua = DEFAULT_E_CONN_UA;
+}
+
+
+
+void config_load(void) {
+    nvs_handle_t handle;
+    config_apply_defaults(&config);
+    if (nvs_open(CONFIG_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        // blob salvati da firmware precedenti sono più corti: i campi nuovi
+        // in coda restano ai default
+        size_t len = 0;
+        if (nvs_get_blob(handle, "data", NULL, &len) == ESP_OK && len > 0 && len <= sizeof(config) &&
+            nvs_get_blob(handle, "data", &config, &len) == ESP_OK) {
+            loaded = true;
+            if (len < offsetof(config_data_t, batt_mv_max) + sizeof(config.batt_mv_max)) {
+                // soglie batteria salvate in volt (float): unica conversione, poi solo mV
+                config.batt_mv_min = (uint16_t)(config.batt_v_min * 1000.0f + 0.5f);
+                config.batt_mv_max = (uint16_t)(config.batt_v_max * 1000.0f + 0.5f);
+            }
+        }
+        nvs_close(handle);
+    }
+/*     if (!loaded) 
+    {
+        // === NEW: se non trovato → default + salva
+        config_apply_defaults(&config);
+        config_save(&config);
+        //loaded = true;
+    } */
+    if (config.wifi_ssid[0] == '\0') 
+    {
+        ESP_LOGW("PROVISIONING","SSID vuoto: avvio provisioning");
+        loaded = false;
+    }
+}
+
+bool config_is_valid(void) {
+    return loaded;
+}
+
+
+void config_save(const config_data_t *data) {
+    nvs_handle_t handle;
+    if (nvs_open(CONFIG_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_blob(handle, "data", data, sizeof(*data));
+        nvs_commit(handle);
+        nvs_close(handle);
+        config = *data;
+        loaded = true;
+    }
+}
+
+config_data_t config_get(void) {
+    return config;
+}
+
+// === NEW: setter ===
+bool config_set_batt_range_mv(uint16_t mv_min, uint16_t mv_max)
+{
+    if (mv_max <= mv_min || mv_min < 2500 || mv_max > 5500) return false;
+    config.batt_mv_min = mv_min;
+    config.batt_mv_max = mv_max;
+    config_save(&config);
+    return true;
+}
+
+bool config_set_soil_wet_raw(uint16_t raw) 
+{
+    config.soil_wet_raw = raw;
+    config_save(&config);
+    return true;
+}
+
+bool config_set_soil_dry_raw(uint16_t raw) 
+{
+    config.soil_dry_raw = raw;
+    config_save(&config);
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CONFIG_NAMESPACE "soilcfg"
+
+typedef struct {
+    char wifi_ssid[64];
+    char wifi_pass[64];
+    char mqtt_host[64];
+    int mqtt_port;
+    char mqtt_user[32];
+    char mqtt_pass[32];
+    int sleep_minutes;
+    float batt_v_min;      // V, solo per migrare i blob vecchi: usare batt_mv_min
+    float batt_v_max;      // V, solo per migrare i blob vecchi: usare batt_mv_max
+    uint16_t soil_wet_raw; // ADC "bagnato"
+    uint16_t soil_dry_raw; // ADC "asciutto"
+    // IP statico opzionale (vuoto = DHCP)
+    char static_ip[16];
+    char static_gw[16];
+    char static_mask[16];
+    char static_dns[16];
+    uint16_t hist_period_h; // ore tra due riepiloghi latenza (0 = disattivo)
+    // modello energetico: corrente per stato (uA) e capacità batteria
+    uint32_t e_radio_ua;    // radio accesa (media TX/RX)
+    uint32_t e_cpu_ua;      // CPU attiva, radio spenta
+    uint32_t e_probe_ua;    // sonda alimentata (carico aggiuntivo)
+    uint32_t e_sleep_ua;    // deep sleep (scheda completa)
+    uint16_t batt_capacity_mah;
+    // policy batteria: soglie in mV sopra batt_v_min
+    uint16_t pol_stretch_mv;     // sotto questa soglia l'intervallo si allunga
+    uint16_t pol_crit_mv;        // sotto questa soglia niente radio
+    uint8_t  pol_max_factor;     // allungamento massimo (x intervallo)
+    uint8_t  pol_heartbeat_every; // in critico, un risveglio con radio ogni N
+    // risveglio predittivo dalla tendenza dell'umidità
+    uint8_t  trend_enabled;
+    uint16_t trend_min_minutes;  // intervallo minimo (cambiamenti rapidi)
+    uint16_t trend_max_minutes;  // intervallo massimo (umidità stabile)
+    uint16_t trend_deadband_pm;  // variazione che merita una lettura (per-mille)
+    uint16_t trend_threshold_pm; // soglia utente (per-mille, 0 = nessuna)
+    int32_t  wake_slot_s;        // offset nella griglia di risveglio (-1 = dal device ID)
+    uint16_t sntp_every;         // risincronizzazione SNTP ogni N risvegli (0 = solo al cold boot)
+    uint8_t  stub_skip;          // risvegli gestiti dal wake stub tra due letture complete
+    uint16_t health_every;       // messaggio diag di salute ogni N risvegli con radio (0 = solo dopo reset)
+    // batteria in virgola fissa: soglie in mV, mV = (raw * scale_q16) >> 16 + offset
+    uint16_t batt_mv_min;
+    uint16_t batt_mv_max;
+    uint32_t vbat_scale_q16;     // mV per conteggio ADC in Q16, partitore incluso
+    int16_t  vbat_offset_mv;     // correzione additiva
+    uint8_t  disc_mode;          // discovery HA: DISC_MODE_ENTITY o DISC_MODE_DEVICE
+    // configurazione di flotta: soil_sensor/all e soil_sensor/group/<group>
+    char     group[16];          // gruppo ([a-z0-9_-], vuoto = nessuno)
+    uint32_t local_mask;         // impostazioni fissate sul singolo dispositivo (bit per impostazione MQTT)
+    // intervalli brevi: Wi-Fi associato in power save invece del deep sleep
+    uint8_t  conn_mode;          // CONN_MODE_*
+    uint8_t  listen_interval;    // beacon tra due ascolti in modem sleep (dalla prossima associazione)
+    uint32_t e_conn_ua;          // corrente media da associato in power save (modello energetico)
+} config_data_t;
+
+// discovery Home Assistant: un config retained per entità o uno per dispositivo
+#define DISC_MODE_ENTITY 0
+#define DISC_MODE_DEVICE 1
+
+// tra una lettura e l'altra: sempre deep sleep, scelta in base al costo, sempre connesso
+#define CONN_MODE_OFF  0
+#define CONN_MODE_AUTO 1
+#define CONN_MODE_ON   2
+
+
+
+// default sensati 
+#define DEFAULT_BATT_MV_MIN 3200
+#define DEFAULT_BATT_MV_MAX 4200
+// 3300 mV fondo scala su 4095 conteggi, partitore 1:2
+#define DEFAULT_VBAT_SCALE_Q16 105626u
+#define DEFAULT_SOIL_WET_RAW 1200
+#define DEFAULT_SOIL_DRY_RAW 3200
+#define DEFAULT_E_RADIO_UA   80000
+#define DEFAULT_E_CPU_UA     22000
+#define DEFAULT_E_PROBE_UA   5000
+#define DEFAULT_E_SLEEP_UA   45
+#define DEFAULT_BATT_CAPACITY_MAH 1000
+#define DEFAULT_POL_STRETCH_MV 200
+#define DEFAULT_POL_CRIT_MV    50
+#define DEFAULT_POL_MAX_FACTOR 4
+#define DEFAULT_POL_HEARTBEAT_EVERY 12
+#define DEFAULT_TREND_MIN_MINUTES 5
+#define DEFAULT_TREND_MAX_MINUTES 120
+#define DEFAULT_TREND_DEADBAND_PM 20
+#define DEFAULT_HEALTH_EVERY 24
+#define DEFAULT_SNTP_EVERY   96
+#define DEFAULT_LISTEN_INTERVAL 3
+#define DEFAULT_E_CONN_UA    2500
+
+void config_load(void);
+bool config_is_valid(void);
+void config_save(const config_data_t *data);
+
+// comode setter (salvano subito)
+bool config_set_batt_range_mv(uint16_t mv_min, uint16_t mv_max);
+bool config_set_soil_wet_raw(uint16_t raw);
+bool config_set_soil_dry_raw(uint16_t raw);
+
+config_data_t config_get(void);
\ No newline at end of file
@@ -0,0 +1,98 @@
+// test_json_flat.c
+// Documenti config/desired validi e malformati per json_flat.
+
+#include "json_flat.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+// legge tutto il documento: numero di coppie lette, *error come it.error
+static int scan(const char *doc, bool *error)
+{
+    json_flat_t it;
+    char key[16], val[16];
+    int n = 0;
+    json_flat_init(&it, doc);
+    while (json_flat_next(&it, key, sizeof(key), val, sizeof(val))) n++;
+    *error = it.error;
+    return n;
+}
+
+static void expect(const char *doc, int pairs, bool error)
+{
+    bool got_error;
+    int got = scan(doc, &got_error);
+    if (got != pairs || got_error != error) {
+        printf("FAIL %s: %d pairs%s (expected %d%s)\n", doc, got, got_error ? ", error" : "",
+               pairs, error ? ", error" : "");
+        failures++;
+    }
+}
+
+static void test_values(void)
+{
+    json_flat_t it;
+    char key[16], val[16];
+    json_flat_init(&it, " {\"group\": \"a\\\"b\", \"sleep_interval\":15, \"x\":null}\n");
+
+    if (!json_flat_next(&it, key, sizeof(key), val, sizeof(val)) ||
+        strcmp(key, "group") || strcmp(val, "a\"b") || !it.string) {
+        printf("FAIL string value\n");
+        failures++;
+    }
+    if (!json_flat_next(&it, key, sizeof(key), val, sizeof(val)) ||
+        strcmp(key, "sleep_interval") || strcmp(val, "15") || it.string) {
+        printf("FAIL number value\n");
+        failures++;
+    }
+    if (!json_flat_next(&it, key, sizeof(key), val, sizeof(val)) || strcmp(val, "null") || it.string) {
+        printf("FAIL null value\n");
+        failures++;
+    }
+    if (json_flat_next(&it, key, sizeof(key), val, sizeof(val)) || it.error) {
+        printf("FAIL end of object\n");
+        failures++;
+    }
+}
+
+int main(void)
+{
+    test_values();
+
+    expect("{}", 0, false);
+    expect(" { } \r\n", 0, false);
+    expect("{\"a\":1}", 1, false);
+    expect("{\"a\":1,\"b\":\"x\"}", 2, false);
+
+    // virgole fuori posto
+    expect("{,\"a\":1}", 0, true);
+    expect("{\"a\":1,}", 1, true);
+    expect("{\"a\":1,,\"b\":2}", 1, true);
+    expect("{\"a\":1 \"b\":2}", 0, true);
+    // testo dopo la chiusura (le coppie lette restano valide)
+    expect("{\"a\":1}x", 1, true);
+    expect("{\"a\":1}}", 1, true);
+    expect("{}{\"a\":1}", 0, true);
+    // struttura
+    expect("", 0, true);
+    expect("[1]", 0, true);
+    expect("{\"a\":1", 0, true);
+    expect("{\"a\"1}", 0, true);
+    expect("{a:1}", 0, true);
+    expect("{\"a\":}", 0, true);
+    expect("{\"a\":{\"b\":1}}", 0, true);
+    expect("{\"a\":[1]}", 0, true);
+    expect("{\"a\":\"x}", 0, true);
+    expect("{\"a\":\"\\u0041\"}", 0, true);
+    // chiave o valore oltre il buffer
+    expect("{\"a_very_long_key_name\":1}", 0, true);
+    expect("{\"a\":12345678901234567890}", 0, true);
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("json_flat: all tests passed\n");
+    return 0;
+}
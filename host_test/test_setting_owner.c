@@ -0,0 +1,118 @@
+// test_setting_owner.c
+// Precedenza tra set/* (dal vivo e retained) e documenti di configurazione,
+// con lo stesso flusso di mqtt_cmd_run()/mqtt_cmd_desired() ridotto a una
+// sola impostazione (sleep_interval).
+
+#include "setting_owner.h"
+#include <stdio.h>
+
+#define BIT 1u   // 1u << CMD_SET_SLEEP
+
+typedef struct {
+    int value;
+    uint32_t local_mask;   // config (NVS)
+    uint32_t fleet_mask;   // RTC, ricalcolata da ogni documento
+} device_t;
+
+static int failures = 0;
+
+// mqtt_cmd_run(): applica e, se cambia, fissa secondo l'origine
+static void set(device_t *d, setting_origin_t from, int value)
+{
+    if (!setting_owner_accept(from, BIT, d->local_mask, d->fleet_mask)) return;
+    if (d->value != value) {
+        d->value = value;
+        if (setting_owner_pins(from)) d->local_mask |= BIT;
+    }
+}
+
+// mqtt_cmd_desired() con un documento di gruppo che contiene l'impostazione
+static void group_doc(device_t *d, int value)
+{
+    uint32_t taken = 0;
+    if (setting_owner_accept(SETTING_FROM_FLEET_DOC, BIT, d->local_mask, d->fleet_mask)) {
+        taken |= BIT;
+        set(d, SETTING_FROM_FLEET_DOC, value);
+    }
+    d->fleet_mask = taken;
+}
+
+static void check(const char *what, const device_t *d, int value, bool local)
+{
+    if (d->value != value || !!(d->local_mask & BIT) != local) {
+        printf("FAIL %s: value %d%s (expected %d%s)\n", what, d->value,
+               (d->local_mask & BIT) ? " local" : "", value, local ? " local" : "");
+        failures++;
+    }
+}
+
+static void test_stale_retained_after_group_update(void)
+{
+    device_t d = { .value = 15 };
+    // valore impostato da HA mentre il sensore dormiva: resta retained sul broker
+    set(&d, SETTING_FROM_RETAINED, 30);
+    check("retained without fleet document", &d, 30, false);
+
+    // la flotta cambia l'intervallo per il gruppo
+    group_doc(&d, 10);
+    check("group update", &d, 10, false);
+
+    // risvegli successivi: il set retained ormai vecchio arriva prima o dopo il documento
+    set(&d, SETTING_FROM_RETAINED, 30);
+    check("stale retained before document", &d, 10, false);
+    group_doc(&d, 10);
+    set(&d, SETTING_FROM_RETAINED, 30);
+    check("stale retained after document", &d, 10, false);
+
+    // un nuovo documento di gruppo vale ancora
+    group_doc(&d, 20);
+    check("second group update", &d, 20, false);
+}
+
+static void test_live_command_overrides_fleet(void)
+{
+    device_t d = { .value = 15 };
+    group_doc(&d, 10);
+    set(&d, SETTING_FROM_COMMAND, 5);
+    check("live command", &d, 5, true);
+    group_doc(&d, 20);
+    check("group after live command", &d, 5, true);
+    // fissata sul dispositivo: i retained la seguono di nuovo
+    set(&d, SETTING_FROM_RETAINED, 7);
+    check("retained on local setting", &d, 7, true);
+}
+
+static void test_device_doc_pins(void)
+{
+    device_t d = { .value = 15 };
+    set(&d, SETTING_FROM_DEVICE_DOC, 45);
+    check("device document", &d, 45, true);
+    group_doc(&d, 10);
+    check("group after device document", &d, 45, true);
+    if (d.fleet_mask & BIT) {
+        printf("FAIL fleet owns a local setting\n");
+        failures++;
+    }
+}
+
+static void test_echo_does_not_pin(void)
+{
+    device_t d = { .value = 15 };
+    set(&d, SETTING_FROM_COMMAND, 15);
+    check("command with the current value", &d, 15, false);
+}
+
+int main(void)
+{
+    test_stale_retained_after_group_update();
+    test_live_command_overrides_fleet();
+    test_device_doc_pins();
+    test_echo_does_not_pin();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("setting_owner: all tests passed\n");
+    return 0;
+}
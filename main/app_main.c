@@ -5,31 +5,79 @@
 #include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_netif.h"
-#include "wifi_provisioning.h"
+#include "wifi_sta.h"
 #include "mqtt_wrapper.h"
 #include "sensor.h"
 #include "sleep_control.h"
 #include "config.h"
+#include "ip_cache.h"
+#include "wake_trace.h"
+#include "energy.h"
+#include "moisture_trend.h"
+#include "time_sync.h"
+#include "log_ring.h"
+#include "health.h"
+#include "cmd_worker.h"
+#include "fixed_point.h"
 #include "esp_wifi.h"
 #include "freertos/event_groups.h"
 
 static const char *TAG = "MAIN";
 static EventGroupHandle_t wifi_event_group;
+static StaticEventGroup_t wifi_event_group_buf;
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_DISCONNECTED_BIT BIT1
+// oltre questi tentativi si torna a dormire invece di scaricare la batteria
+#define WIFI_MAX_RECONNECTS 8
+// attese MQTT per risveglio: connessione al broker, PUBACK prima dello sleep
+#define MQTT_CONNECT_WAIT_MS 5000
+#define MQTT_ACK_WAIT_MS     2000
+// comandi ricevuti (es. calibrazione: ~5 s di ADC) da completare prima dello sleep
+#define CMD_WAIT_MS          8000
+
+// task e stack statici: nessuna allocazione in heap dopo l'avvio.
+// Margine reale: "stack.battery" nel messaggio diag (byte mai usati)
+#define BATTERY_TASK_STACK 4096
+static StaticTask_t battery_task_tcb;
+static StackType_t battery_task_stack[BATTERY_TASK_STACK];
+static TaskHandle_t battery_task_handle = NULL;
 
 void battery_task(void *param) {
+    bool connected_cycle = false;
     while (1) {
-        float vbat = read_battery_voltage();
-        float humidity = read_soil_moisture(); // forced
-
-        if (vbat > 0) {
-            char msg[16];
-            snprintf(msg, sizeof(msg), "%.2f", vbat);
-            mqtt_publish_sensor_data(humidity, vbat);
-            vTaskDelay(pdMS_TO_TICKS(2000));  // aspetta 2s per sicurezza che parta MQTT
+        int vbat_mv = read_battery_mv();
+        int humidity_pm = read_soil_moisture_pm(); // forced
+        wake_trace_mark(WT_ADC_DONE);
+        moisture_trend_add(humidity_pm);
+        // da connesso niente boot: la policy si aggiorna a ogni lettura (radio in power save)
+        if (connected_cycle) sleep_policy_update(vbat_mv);
+
+        bool online = false;
+        if (vbat_mv > 0 && mqtt_wait_connected(MQTT_CONNECT_WAIT_MS)) {
+            mqtt_publish_session();   // discovery + echo, con backpressure sul pool
+            mqtt_publish_policy();    // tier a ogni lettura, anche da connesso
+            mqtt_publish_sensor_data(humidity_pm, vbat_mv);
+            mqtt_publish_energy(batt_percent_from_mv(vbat_mv));
+            mqtt_publish_health();
+            mqtt_publish_log(false);  // solo se c'è stato un errore
+            cmd_worker_wait_idle(CMD_WAIT_MS);
+            mqtt_wait_idle(MQTT_ACK_WAIT_MS);
+            online = true;
+        } else if (vbat_mv > 0 && ip_cache_source() == IP_SRC_CACHED) {
+            // associati ma il broker non risponde: il lease in cache può non essere più nostro
+            ip_cache_invalidate(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
+        }
+
+        // intervalli brevi: resta associato invece di ricostruire Wi-Fi e MQTT
+        if (online && sleep_stay_connected()) {
+            sleep_connected_wait();
+            health_next_cycle();
+            connected_cycle = true;
+            continue;
         }
 
+        // "sleeping" + DISCONNECT: il broker non pubblica il last will
+        if (online && sleep_policy_interval_s() > 0) mqtt_sleep(MQTT_ACK_WAIT_MS);
         enter_deep_sleep();  // sleep if enabled
     }
 }
@@ -37,17 +85,34 @@ void battery_task(void *param) {
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wake_trace_mark(WT_WIFI_ASSOC);
+        ip_cache_on_connected(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGW(TAG, "Wi-Fi disconnected, trying to reconnect...");
-        esp_wifi_connect();
+        if (wifi_reconnect_attempts() >= WIFI_MAX_RECONNECTS) {
+            ESP_LOGW(TAG, "Giving up on Wi-Fi for this wake");
+            enter_deep_sleep();
+        }
+        health_note_retry(HEALTH_RETRY_WIFI);
+        wifi_reconnect_with_backoff();
         xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
         xEventGroupSetBits(wifi_event_group, WIFI_DISCONNECTED_BIT);
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
+        wake_trace_mark(WT_GOT_IP);
         ESP_LOGI(TAG, "Got IP, starting MQTT...");
+        ip_cache_on_got_ip(event->esp_netif);
+        wifi_reconnect_reset();
+        time_sync_start_if_due();  // riferimento per la deriva RTC, non bloccante
 
         start_mqtt();
-        xTaskCreate(battery_task, "battery_task", 4096, NULL, 5, NULL);
+        if (battery_task_handle == NULL) {  // GOT_IP arriva di nuovo dopo una riconnessione
+            battery_task_handle = xTaskCreateStatic(battery_task, "battery_task", BATTERY_TASK_STACK,
+                                                    NULL, 5, battery_task_stack, &battery_task_tcb);
+        }
 
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
         xEventGroupClearBits(wifi_event_group, WIFI_DISCONNECTED_BIT);
@@ -56,6 +121,8 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
 
 
 void app_main(void) {
+    wake_trace_mark(WT_APP_MAIN);
+    log_ring_init();  // da qui i log vanno nel ring in RTC, non sulla UART
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
@@ -63,20 +130,31 @@ void app_main(void) {
     }
 
     config_load();
+    wake_trace_mark(WT_NVS_LOADED);
+    energy_on_wake();
     sensor_init();  // Inizializza i sensori
+    wake_trace_mark(WT_SENSOR_INIT);
+#if CONFIG_SOIL_FIXED_POINT_BENCH && !CONFIG_NEWLIB_NANO_FORMAT
+    fixed_point_bench();
+#endif
 
     if (!config_is_valid()) {
         ESP_LOGI(TAG, "No valid config found, starting provisioning.");
-        start_wifi_provisioning();
+        wifi_boot_provisioning();
         return;
     }
-    
+
+    // batteria letta a radio spenta: il calo in TX non deve far scattare la policy
+    // (in critico i risvegli senza radio li gestisce il wake stub)
+    sleep_policy_update(read_battery_mv());
+    sleep_power_on_spread();
 
     // Event loop + handler per connessione Wi-Fi
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    wifi_event_group = xEventGroupCreate();
+    wifi_event_group = xEventGroupCreateStatic(&wifi_event_group_buf);
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
 
+    wake_trace_mark(WT_WIFI_START);
     wifi_connect_from_config();  // si connette, poi chiama la callback
 }
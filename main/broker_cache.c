@@ -0,0 +1,109 @@
+// broker_cache.c
+// Cache RTC dell'indirizzo del broker: evita una query DNS a ogni risveglio.
+
+#include "broker_cache.h"
+#include "rtc_clock.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "lwip/ip4_addr.h"
+#include <string.h>
+#include <inttypes.h>
+
+#define TAG "BROKER"
+
+#define BROKER_CACHE_MAGIC  0xB60CE127u
+// lwIP non espone il TTL dei record DNS: usiamo un TTL fisso prudente
+#define BROKER_CACHE_TTL_S  3600
+
+typedef struct {
+    uint32_t magic;
+    uint32_t host_hash;    // la cache vale solo per lo stesso hostname
+    uint32_t addr;         // IPv4, network byte order
+    uint64_t expires_us;   // rtc_clock_now_us()
+} broker_cache_t;
+
+static RTC_DATA_ATTR broker_cache_t cache;
+static bool used_cached = false;
+
+static uint32_t host_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void addr_to_str(uint32_t addr, char *out, size_t out_len)
+{
+    struct in_addr a = { .s_addr = addr };
+    inet_ntoa_r(a, out, out_len);
+}
+
+static bool cache_valid(const char *host)
+{
+    return cache.magic == BROKER_CACHE_MAGIC && cache.host_hash == host_hash(host) &&
+           rtc_clock_now_us() < cache.expires_us;
+}
+
+bool broker_cache_lookup(const char *host, char *out, size_t out_len)
+{
+    used_cached = false;
+
+    // già un indirizzo IP: niente DNS né cache
+    ip4_addr_t literal;
+    if (ip4addr_aton(host, &literal)) {
+        strlcpy(out, host, out_len);
+        return true;
+    }
+
+    if (cache_valid(host)) {
+        addr_to_str(cache.addr, out, out_len);
+        used_cached = true;
+        ESP_LOGI(TAG, "%s -> %s (cached)", host, out);
+        return true;
+    }
+    return false;
+}
+
+void broker_cache_refresh(const char *host)
+{
+    ip4_addr_t literal;
+    if (ip4addr_aton(host, &literal) || cache_valid(host)) return;
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    int err = getaddrinfo(host, NULL, &hints, &res);
+    if (err != 0 || res == NULL) {
+        ESP_LOGW(TAG, "DNS lookup for %s failed (%d)", host, err);
+        cache.magic = 0;
+        return;
+    }
+
+    cache.addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    cache.host_hash = host_hash(host);
+    cache.expires_us = rtc_clock_now_us() + (uint64_t)BROKER_CACHE_TTL_S * 1000000ULL;
+    cache.magic = BROKER_CACHE_MAGIC;
+
+    char out[16];
+    addr_to_str(cache.addr, out, sizeof(out));
+    ESP_LOGI(TAG, "%s -> %s (resolved, cached for %d s)", host, out, BROKER_CACHE_TTL_S);
+}
+
+bool broker_cache_used_cached(void)
+{
+    return used_cached;
+}
+
+void broker_cache_invalidate(void)
+{
+    cache.magic = 0;
+    used_cached = false;
+}
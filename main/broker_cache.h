@@ -0,0 +1,19 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// IPv4 testuale dell'host MQTT dalla cache RTC, senza DNS (non blocca).
+// Ritorna true se out contiene un indirizzo IP (in cache o già letterale),
+// false se manca (in quel caso usare l'hostname: lo risolve esp-mqtt nel suo task).
+bool broker_cache_lookup(const char *host, char *out, size_t out_len);
+
+// Riempie la cache se manca o è scaduta. getaddrinfo() blocca: da chiamare
+// dopo la connessione al broker (risposta già nella cache DNS di lwIP),
+// mai dal task degli eventi Wi-Fi.
+void broker_cache_refresh(const char *host);
+
+// true se l'ultimo broker_cache_lookup() ha usato un indirizzo in cache
+bool broker_cache_used_cached(void);
+
+// da chiamare se la connessione all'indirizzo in cache fallisce
+void broker_cache_invalidate(void);
@@ -0,0 +1,127 @@
+// cmd_worker.c
+// Esecuzione dei comandi MQTT in un task dedicato: l'handler MQTT si limita a
+// convertire e accodare, così keepalive e PUBACK non restano bloccati durante
+// letture ADC lunghe o scritture NVS.
+
+#include "cmd_worker.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#define TAG "CMD"
+
+// stack: config_save (NVS) + buffer di pubblicazione del log (512 B)
+#define CMD_TASK_STACK 4096
+#define CMD_TASK_PRIO  4   // sotto il task MQTT
+
+static StaticTask_t cmd_task_tcb;
+static StackType_t cmd_task_stack[CMD_TASK_STACK];
+static TaskHandle_t cmd_task_handle = NULL;
+
+// in coda viaggia solo il tipo: al massimo uno per tipo grazie all'accorpamento
+static StaticQueue_t queue_buf;
+static uint8_t queue_storage[CMD_COUNT];
+static QueueHandle_t queue = NULL;
+
+static cmd_t slots[CMD_COUNT];        // ultimo comando ricevuto per tipo
+static uint8_t merged[CMD_COUNT];     // richieste assorbite da quella in coda
+static uint32_t pending = 0;          // bit per tipo in coda
+static volatile bool busy = false;    // comando o salvataggio in corso
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const cmd_worker_ops_t *ops = NULL;
+
+static void cmd_task(void *param)
+{
+    uint8_t type;
+    for (;;) {
+        if (xQueueReceive(queue, &type, portMAX_DELAY) != pdTRUE) continue;
+
+        portENTER_CRITICAL(&lock);
+        cmd_t cmd = slots[type];
+        unsigned n_merged = merged[type];
+        merged[type] = 0;
+        pending &= ~(1u << type);
+        busy = true;
+        portEXIT_CRITICAL(&lock);
+
+        int64_t t0 = esp_timer_get_time();
+        bool ok = ops->run(&cmd);
+        uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+        ESP_LOGI(TAG, "%s %s in %u ms (%u merged)", cmd_name(cmd.type), ok ? "done" : "rejected",
+                 (unsigned)ms, n_merged);
+        if (ops->done) ops->done(&cmd, ok, ms, n_merged);
+
+        if (uxQueueMessagesWaiting(queue) == 0) {
+            if (ops->idle) ops->idle();
+            busy = false;
+        }
+    }
+}
+
+void cmd_worker_start(const cmd_worker_ops_t *worker_ops)
+{
+    if (cmd_task_handle) return;
+    ops = worker_ops;
+    queue = xQueueCreateStatic(CMD_COUNT, sizeof(uint8_t), queue_storage, &queue_buf);
+    cmd_task_handle = xTaskCreateStatic(cmd_task, "cmd_task", CMD_TASK_STACK, NULL,
+                                        CMD_TASK_PRIO, cmd_task_stack, &cmd_task_tcb);
+}
+
+bool cmd_post(const cmd_t *cmd)
+{
+    if (!queue || cmd->type >= CMD_COUNT) return false;
+    uint8_t type = (uint8_t)cmd->type;
+
+    portENTER_CRITICAL(&lock);
+    slots[type] = *cmd;
+    bool queued = pending & (1u << type);
+    if (queued) {
+        if (merged[type] < UINT8_MAX) merged[type]++;
+    } else {
+        pending |= 1u << type;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    // un posto per tipo: l'invio non può fallire
+    if (!queued) xQueueSend(queue, &type, 0);
+    return true;
+}
+
+bool cmd_worker_wait_idle(uint32_t timeout_ms)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (pending || busy) {
+        if (esp_timer_get_time() >= end) return false;
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    return true;
+}
+
+const char *cmd_name(cmd_type_t type)
+{
+    static const char *const names[CMD_COUNT] = {
+        [CMD_SET_SLEEP]        = "sleep_interval",
+        [CMD_SET_VMIN]         = "batt_v_min",
+        [CMD_SET_VMAX]         = "batt_v_max",
+        [CMD_SET_WET]          = "soil_wet_raw",
+        [CMD_SET_DRY]          = "soil_dry_raw",
+        [CMD_SET_HIST_PERIOD]  = "hist_period_h",
+        [CMD_SET_ENERGY_MODEL] = "energy_model",
+        [CMD_SET_BATT_POLICY]  = "batt_policy",
+        [CMD_SET_TREND]        = "trend",
+        [CMD_SET_WAKE_SLOT]    = "wake_slot_s",
+        [CMD_SET_STUB_SKIP]    = "stub_skip",
+        [CMD_SET_HEALTH_EVERY] = "health_every",
+        [CMD_SET_DISC_MODE]    = "discovery_mode",
+        [CMD_SET_GROUP]        = "group",
+        [CMD_SET_CONN_SLEEP]   = "conn_sleep",
+        [CMD_MARK_WET]         = "mark_wet",
+        [CMD_MARK_DRY]         = "mark_dry",
+        [CMD_LOG_FLUSH]        = "log_flush",
+        [CMD_CONFIG_DESIRED]   = "config_desired",
+    };
+    return (type < CMD_COUNT && names[type]) ? names[type] : "unknown";
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Comandi ricevuti via MQTT ed eseguiti fuori dal task MQTT.
+// Un comando dello stesso tipo già in coda viene sostituito dal più recente.
+typedef enum {
+    CMD_SET_SLEEP = 0,
+    CMD_SET_VMIN,
+    CMD_SET_VMAX,
+    CMD_SET_WET,
+    CMD_SET_DRY,
+    CMD_SET_HIST_PERIOD,
+    CMD_SET_ENERGY_MODEL,
+    CMD_SET_BATT_POLICY,
+    CMD_SET_TREND,
+    CMD_SET_WAKE_SLOT,
+    CMD_SET_STUB_SKIP,
+    CMD_SET_HEALTH_EVERY,
+    CMD_SET_DISC_MODE,
+    CMD_SET_GROUP,
+    CMD_SET_CONN_SLEEP,
+    // impostazioni (con eco retained) prima dei comandi
+    CMD_MARK_WET,
+    CMD_MARK_DRY,
+    CMD_LOG_FLUSH,
+    CMD_CONFIG_DESIRED,
+    CMD_COUNT
+} cmd_type_t;
+
+// le impostazioni CMD_SET_* sono i tipi [0, CMD_SETTINGS_END)
+#define CMD_SETTINGS_END CMD_MARK_WET
+
+// argomenti già convertiti e validati dal parser
+typedef struct {
+    cmd_type_t type;
+    bool retained;   // consegna retained (alla sottoscrizione), non una richiesta nuova
+    union {
+        int32_t i;
+        uint32_t u[5];
+        char s[20];
+    } arg;
+} cmd_t;
+
+typedef struct {
+    bool (*run)(const cmd_t *cmd);   // esegue il comando, false se rifiutato
+    // fine esecuzione: durata e richieste uguali assorbite mentre era in coda
+    void (*done)(const cmd_t *cmd, bool ok, uint32_t ms, unsigned merged);
+    void (*idle)(void);              // coda vuota: salvataggi accorpati
+} cmd_worker_ops_t;
+
+// crea coda e task (statici); chiamate successive non fanno nulla
+void cmd_worker_start(const cmd_worker_ops_t *ops);
+
+// accoda senza bloccare; false se il worker non è avviato
+bool cmd_post(const cmd_t *cmd);
+
+// attende che coda e comando in corso siano terminati (prima del deep sleep)
+bool cmd_worker_wait_idle(uint32_t timeout_ms);
+
+const char *cmd_name(cmd_type_t type);
@@ -0,0 +1,48 @@
+#pragma once
+
+// Entità Home Assistant pubblicate in discovery: una riga per entità.
+// I payload sono letterali composti a compile time; a runtime si aggiungono
+// solo "~" (= soil_sensor/<id>), unique_id, availability, expire_after e
+// blocco device con l'ID.
+// Chiavi abbreviate come previsto dalla discovery MQTT di HA.
+
+#define HA_NAME(n)    "\"name\":\"" n "\""
+#define HA_STATE(t)   ",\"stat_t\":\"~/" t "\""
+#define HA_CMD(t)     ",\"cmd_t\":\"~/" t "\""
+#define HA_VALUE(v)   ",\"val_tpl\":\"{{ value_json." v " }}\""
+#define HA_UNIT(u)    ",\"unit_of_meas\":\"" u "\""
+#define HA_CLASS(c)   ",\"dev_cla\":\"" c "\""
+#define HA_ICON(i)    ",\"ic\":\"" i "\""
+#define HA_MEAS       ",\"stat_cla\":\"measurement\""
+#define HA_TOTAL      ",\"stat_cla\":\"total_increasing\""
+#define HA_DIAG       ",\"ent_cat\":\"diagnostic\""
+#define HA_PRESS      ",\"pl_prs\":\"1\""
+#define HA_CONFIG     ",\"ent_cat\":\"config\""
+#define HA_OPTIONS(o) ",\"ops\":[" o "],\"ret\":true"
+#define HA_RANGE(mn, mx, st) ",\"min\":" #mn ",\"max\":" #mx ",\"step\":" #st ",\"mode\":\"box\",\"ret\":true"
+
+// X(componente, object id nel topic homeassistant/<comp>/soil_<id>_<obj>/config,
+//   suffisso di unique_id, aggiornato a ogni risveglio con radio (1 = riceve
+//   expire_after, solo per i sensor), campi)
+#define DISCOVERY_ENTITIES(X) \
+    X(sensor, humidity,       humidity,       1, HA_NAME("Soil Humidity") HA_STATE("humidity") HA_UNIT("%") HA_CLASS("humidity")) \
+    X(sensor, battery,        battery,        1, HA_NAME("Battery Voltage") HA_STATE("battery") HA_UNIT("V") HA_CLASS("voltage")) \
+    X(sensor, battery_pct,    battery_pct,    1, HA_NAME("Battery %") HA_STATE("battery_pct") HA_UNIT("%") HA_CLASS("battery")) \
+    X(sensor, awake_ms,       awake_ms,       0, HA_NAME("Awake Time") HA_STATE("awake_ms") HA_UNIT("ms") HA_CLASS("duration") HA_MEAS HA_DIAG) \
+    X(sensor, energy_mah_day, energy_mah_day, 1, HA_NAME("Energy per Day") HA_STATE("energy_mah_day") HA_UNIT("mAh") HA_MEAS HA_DIAG) \
+    X(sensor, batt_days_left, batt_days_left, 0, HA_NAME("Battery Days Left") HA_STATE("batt_days_left") HA_UNIT("d") HA_CLASS("duration") HA_DIAG) \
+    X(sensor, policy_tier,    policy_tier,    1, HA_NAME("Battery Policy") HA_STATE("policy_tier") HA_ICON("mdi:battery-clock") HA_DIAG) \
+    X(sensor, rssi,           rssi,           0, HA_NAME("RSSI") HA_STATE("diag") HA_VALUE("rssi") HA_UNIT("dBm") HA_CLASS("signal_strength") HA_MEAS HA_DIAG) \
+    X(sensor, heap_min,       heap_min,       0, HA_NAME("Min Free Heap") HA_STATE("diag") HA_VALUE("heap_min") HA_UNIT("B") HA_MEAS HA_DIAG) \
+    X(sensor, reset_reason,   reset_reason,   0, HA_NAME("Reset Reason") HA_STATE("diag") HA_VALUE("reset") HA_ICON("mdi:restart-alert") HA_DIAG) \
+    X(sensor, wake_count,     wake_count,     0, HA_NAME("Wake Count") HA_STATE("diag") HA_VALUE("wakes") HA_TOTAL HA_DIAG) \
+    X(sensor, wifi_retries,   wifi_retries,   0, HA_NAME("Wi-Fi Retries") HA_STATE("diag") HA_VALUE("retries.wifi_total") HA_TOTAL HA_DIAG) \
+    X(sensor, firmware,       firmware,       0, HA_NAME("Firmware") HA_STATE("diag") HA_VALUE("fw") HA_ICON("mdi:chip") HA_DIAG) \
+    X(number, sleep_interval, sleep_interval, 0, HA_NAME("Sleep Interval") HA_CMD("sleep_interval/set") HA_STATE("sleep_interval") HA_UNIT("min") HA_RANGE(0, 1440, 1)) \
+    X(number, batt_vmin,      batt_v_min,     0, HA_NAME("Batt Vmin") HA_CMD("set/batt_v_min") HA_STATE("batt_v_min") HA_UNIT("V") HA_RANGE(2.5, 5.5, 0.01)) \
+    X(number, batt_vmax,      batt_v_max,     0, HA_NAME("Batt Vmax") HA_CMD("set/batt_v_max") HA_STATE("batt_v_max") HA_UNIT("V") HA_RANGE(2.5, 5.5, 0.01)) \
+    X(number, wet_raw,        soil_wet_raw,   0, HA_NAME("Soil Wet RAW") HA_CMD("set/soil_wet_raw") HA_STATE("soil_wet_raw") HA_RANGE(0, 4095, 1)) \
+    X(number, dry_raw,        soil_dry_raw,   0, HA_NAME("Soil Dry RAW") HA_CMD("set/soil_dry_raw") HA_STATE("soil_dry_raw") HA_RANGE(0, 4095, 1)) \
+    X(button, mark_wet,       soil_mark_wet,  0, HA_NAME("Segna Bagnato") HA_CMD("cmd/soil_mark_wet") HA_PRESS) \
+    X(button, mark_dry,       soil_mark_dry,  0, HA_NAME("Segna Asciutto") HA_CMD("cmd/soil_mark_dry") HA_PRESS) \
+    X(select, discovery_mode, discovery_mode, 0, HA_NAME("Discovery Mode") HA_CMD("set/discovery_mode") HA_STATE("discovery_mode") HA_OPTIONS("\"entity\",\"device\"") HA_CONFIG)
@@ -0,0 +1,186 @@
+// energy.c
+// Stima del consumo per fase del risveglio e proiezione della durata batteria.
+
+#include "energy.h"
+#include "config.h"
+#include "rtc_clock.h"
+#include "wake_trace.h"
+#include "sensor.h"
+#include "wake_stub.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <inttypes.h>
+#include <string.h>
+
+#define TAG "ENERGY"
+
+#define ENERGY_MAGIC        0xE4E76031u
+#define ENERGY_NVS_NS       "energy"
+#define DAY_S               86400ULL
+// salvataggio in NVS al massimo una volta ogni tot risvegli (usura flash)
+#define ENERGY_PERSIST_EVERY 48
+// durata stimata di un risveglio gestito dal wake stub (ROM + stub)
+#define STUB_WAKE_US        6000
+
+typedef struct {
+    uint64_t total_uas;        // carica totale (uA*s)
+    uint64_t total_s;          // tempo totale contabilizzato (s)
+    uint64_t day_uas;          // carica nella finestra giornaliera corrente
+    uint64_t day_s;            // durata della finestra corrente
+    uint32_t mah_day_x100;     // media mobile mAh/giorno (x100)
+} energy_totals_t;
+
+typedef struct {
+    uint32_t magic;
+    energy_totals_t t;
+    uint64_t sleep_start_us;   // rtc_clock_now_us() all'ingresso in deep sleep
+    uint32_t wakes_since_persist;
+    uint32_t wake_uas;         // media mobile del costo di un risveglio con radio
+} energy_rtc_t;
+
+static RTC_DATA_ATTR energy_rtc_t st;
+
+// già addebitati da energy_on_connected() in questo boot
+static uint64_t connected_us = 0;
+static uint64_t probe_charged_us = 0;
+
+static void persist(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(ENERGY_NVS_NS, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_blob(h, "totals", &st.t, sizeof(st.t));
+        nvs_commit(h);
+        nvs_close(h);
+    }
+    st.wakes_since_persist = 0;
+}
+
+static void restore(void)
+{
+    // power-on: la RTC è persa, si riparte dagli ultimi totali salvati
+    memset(&st, 0, sizeof(st));
+    nvs_handle_t h;
+    if (nvs_open(ENERGY_NVS_NS, NVS_READONLY, &h) == ESP_OK) {
+        size_t len = sizeof(st.t);
+        if (nvs_get_blob(h, "totals", &st.t, &len) != ESP_OK || len != sizeof(st.t)) {
+            memset(&st.t, 0, sizeof(st.t));
+        }
+        nvs_close(h);
+    }
+    st.magic = ENERGY_MAGIC;
+}
+
+static void charge(uint64_t uas)
+{
+    st.t.total_uas += uas;
+    st.t.day_uas += uas;
+}
+
+static void advance_time(uint64_t dur_us)
+{
+    uint64_t s = dur_us / 1000000ULL;
+    st.t.total_s += s;
+    st.t.day_s += s;
+
+    if (st.t.day_s >= DAY_S) {
+        // chiude la finestra giornaliera e aggiorna la media (EWMA 1/4)
+        uint32_t day = (uint32_t)(st.t.day_uas * 100ULL * DAY_S / st.t.day_s / 3600000ULL);
+        st.t.mah_day_x100 = st.t.mah_day_x100 ? (st.t.mah_day_x100 * 3 + day) / 4 : day;
+        st.t.day_uas = 0;
+        st.t.day_s = 0;
+        persist();
+    }
+}
+
+void energy_on_wake(void)
+{
+    if (st.magic != ENERGY_MAGIC) {
+        restore();
+        return;
+    }
+    if (st.sleep_start_us == 0) return;
+
+    uint64_t now = rtc_clock_now_us();
+    if (now > st.sleep_start_us) {
+        uint64_t slept_us = now - st.sleep_start_us;
+        config_data_t c = config_get();
+        charge((uint64_t)c.e_sleep_ua * slept_us / 1000000ULL);
+        // risvegli del wake stub: ROM + stub a CPU accesa
+        charge((uint64_t)c.e_cpu_ua * wake_stub_skipped() * STUB_WAKE_US / 1000000ULL);
+        advance_time(slept_us);
+    }
+    st.sleep_start_us = 0;
+}
+
+void energy_on_sleep(void)
+{
+    if (st.magic != ENERGY_MAGIC) restore();
+
+    config_data_t c = config_get();
+    uint64_t up_us = (uint64_t)esp_timer_get_time();
+    uint64_t wifi_us = wake_trace_get_us(WT_WIFI_START);
+    uint64_t radio_us = (wifi_us && up_us > wifi_us) ? up_us - wifi_us : 0;
+    // il tempo passato connesso è già stato addebitato (radio accesa)
+    radio_us = radio_us > connected_us ? radio_us - connected_us : 0;
+    uint64_t awake_us = up_us - connected_us;
+    uint64_t cpu_us = awake_us - radio_us;
+    uint64_t probe_us = sensor_probe_on_us() - probe_charged_us;
+
+    // radio accesa: c.e_radio_ua sostituisce la corrente della sola CPU;
+    // la sonda è un carico aggiuntivo
+    uint64_t uas = ((uint64_t)c.e_cpu_ua * cpu_us +
+                    (uint64_t)c.e_radio_ua * radio_us +
+                    (uint64_t)c.e_probe_ua * probe_us) / 1000000ULL;
+    charge(uas);
+    advance_time(awake_us);
+    if (radio_us && !connected_us) {
+        st.wake_uas = st.wake_uas ? (uint32_t)((st.wake_uas * 3ULL + uas) / 4) : (uint32_t)uas;
+    }
+
+    ESP_LOGI(TAG, "Wake cost %" PRIu32 " uAh (cpu %" PRIu32 " ms, radio %" PRIu32 " ms, probe %" PRIu32 " ms)",
+             (uint32_t)(uas / 3600ULL), (uint32_t)(cpu_us / 1000), (uint32_t)(radio_us / 1000),
+             (uint32_t)(probe_us / 1000));
+
+    st.sleep_start_us = rtc_clock_now_us();
+    if (++st.wakes_since_persist >= ENERGY_PERSIST_EVERY) persist();
+}
+
+void energy_on_connected(uint64_t us)
+{
+    if (st.magic != ENERGY_MAGIC) restore();
+
+    config_data_t c = config_get();
+    uint64_t probe_us = sensor_probe_on_us() - probe_charged_us;
+    probe_charged_us += probe_us;
+    charge(((uint64_t)c.e_conn_ua * us + (uint64_t)c.e_probe_ua * probe_us) / 1000000ULL);
+    advance_time(us);
+    connected_us += us;
+}
+
+uint32_t energy_wake_uas(void)
+{
+    return st.magic == ENERGY_MAGIC ? st.wake_uas : 0;
+}
+
+uint32_t energy_mah_per_day_x100(void)
+{
+    if (st.t.mah_day_x100) return st.t.mah_day_x100;
+    // prima giornata non ancora conclusa: estrapola dai totali
+    if (st.t.total_s < 3600) return 0;
+    return (uint32_t)(st.t.total_uas * 100ULL * DAY_S / st.t.total_s / 3600000ULL);
+}
+
+uint32_t energy_total_mah(void)
+{
+    return (uint32_t)(st.t.total_uas / 3600000ULL);
+}
+
+int32_t energy_days_remaining(uint8_t batt_pct)
+{
+    uint32_t per_day = energy_mah_per_day_x100();
+    if (per_day == 0) return -1;
+    uint32_t remaining_x100 = (uint32_t)config_get().batt_capacity_mah * batt_pct;  // mAh x100
+    return (int32_t)(remaining_x100 / per_day);
+}
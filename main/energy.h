@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+// Modello energetico: ogni fase del risveglio viene "addebitata" con la corrente
+// configurata per quello stato (config: e_*_ua) e accumulata in RTC/NVS.
+
+// all'avvio (dopo config_load): addebita il deep sleep appena concluso
+void energy_on_wake(void);
+// prima del deep sleep: addebita CPU attiva, radio e sonda del risveglio corrente
+void energy_on_sleep(void);
+
+// sessione connessa (niente deep sleep): addebita `us` alla corrente da
+// associato in power save, più la sonda accesa nel frattempo
+void energy_on_connected(uint64_t us);
+
+// costo medio misurato di un risveglio completo con radio (uA*s, 0 = non ancora noto)
+uint32_t energy_wake_uas(void);
+
+// consumo stimato in mAh/giorno x100 (0 = non ancora stimabile)
+uint32_t energy_mah_per_day_x100(void);
+// consumo totale stimato in mAh dall'ultimo reset dei contatori
+uint32_t energy_total_mah(void);
+// giorni rimanenti stimati dalla % batteria (-1 = non stimabile)
+int32_t energy_days_remaining(uint8_t batt_pct);
@@ -0,0 +1,126 @@
+// fixed_point.c
+// Formattazione e parsing di decimali in virgola fissa, al posto di
+// printf/strtof con float (libreria float di newlib e emulazione software).
+
+#include "fixed_point.h"
+#include "sdkconfig.h"
+
+static const uint32_t pow10_tab[] = {
+    1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+int fixed_format(char *buf, size_t len, int32_t value, unsigned frac, unsigned digits)
+{
+    if (digits > frac || frac > 9) return -1;
+
+    bool neg = value < 0;
+    uint32_t v = neg ? 0u - (uint32_t)value : (uint32_t)value;
+    uint32_t div = pow10_tab[frac - digits];
+    v = v / div + (v % div >= (div + 1) / 2 ? 1u : 0u);  // arrotonda a metà verso l'alto
+    if (v == 0) neg = false;                             // niente "-0.00"
+
+    // cifre al contrario: al massimo 10 + punto + segno
+    char tmp[12];
+    int n = 0;
+    for (unsigned i = 0; i < digits; i++) {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    }
+    if (digits) tmp[n++] = '.';
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (neg) tmp[n++] = '-';
+
+    if ((size_t)n >= len) {
+        if (len) buf[0] = '\0';
+        return -1;
+    }
+    for (int i = 0; i < n; i++) buf[i] = tmp[n - 1 - i];
+    buf[n] = '\0';
+    return n;
+}
+
+bool fixed_parse(const char *s, unsigned frac, int32_t *out)
+{
+    if (frac > 9) return false;
+    while (*s == ' ') s++;
+
+    bool neg = false;
+    if (*s == '-' || *s == '+') neg = (*s++ == '-');
+
+    int64_t v = 0;
+    unsigned got = 0;       // cifre decimali lette
+    bool any = false, dot = false, round_up = false;
+    for (; *s; s++) {
+        if (*s == '.' && !dot) {
+            dot = true;
+            continue;
+        }
+        if (*s < '0' || *s > '9') break;
+        any = true;
+        int d = *s - '0';
+        if (!dot || got < frac) {
+            v = v * 10 + d;
+            if (dot) got++;
+            if (v > INT32_MAX) return false;
+        } else if (got == frac) {
+            round_up = d >= 5;  // conta solo la prima cifra in più
+            got++;
+        }
+    }
+    while (*s == ' ' || *s == '\r' || *s == '\n') s++;
+    if (!any || *s) return false;
+
+    for (; got < frac; got++) v *= 10;
+    if (round_up) v++;
+    if (v > INT32_MAX) return false;
+    *out = neg ? -(int32_t)v : (int32_t)v;
+    return true;
+}
+
+// con newlib nano printf non formatta i float: il confronto non avrebbe senso
+#if CONFIG_SOIL_FIXED_POINT_BENCH && !CONFIG_NEWLIB_NANO_FORMAT
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "config.h"
+#include <stdio.h>
+
+#define TAG "FIXBENCH"
+#define BENCH_N 1000
+
+// Stessa conversione della versione float precedente (raw -> V, raw -> %, printf)
+// contro quella intera (raw -> mV, raw -> per-mille, fixed_format).
+void fixed_point_bench(void)
+{
+    char buf[16];
+    volatile int sink = 0;
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (int raw = 0; raw < BENCH_N; raw++) {
+        float v = (raw / 4095.0f) * 3.3f * 2.0f;
+        float p = 1.0f - ((float)raw / 4095.0f);
+        sink += snprintf(buf, sizeof(buf), "%.2f", v);
+        sink += snprintf(buf, sizeof(buf), "%.1f", p * 100.0f);
+    }
+    uint32_t t_float = esp_cpu_get_cycle_count() - t0;
+
+    t0 = esp_cpu_get_cycle_count();
+    for (int raw = 0; raw < BENCH_N; raw++) {
+        int32_t mv = (int32_t)(((uint32_t)raw * DEFAULT_VBAT_SCALE_Q16 + 32768u) >> 16);
+        int32_t pm = 1000 - (raw * 1000 + 2047) / 4095;
+        sink += fixed_format(buf, sizeof(buf), mv, 3, 2);
+        sink += fixed_format(buf, sizeof(buf), pm, 1, 1);
+    }
+    uint32_t t_fixed = esp_cpu_get_cycle_count() - t0;
+
+    // WARN: resta visibile anche con il profilo release
+    ESP_LOGW(TAG, "cycles per reading: float+printf %u, fixed %u",
+             (unsigned)(t_float / BENCH_N), (unsigned)(t_fixed / BENCH_N));
+}
+#else
+void fixed_point_bench(void)
+{
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Numeri decimali in virgola fissa: il valore intero ha `frac` cifre decimali
+// implicite (es. mV = volt con frac 3, per-mille = % con frac 1).
+// Niente float né printf "%f": su ESP32-C3 (senza FPU) costano cicli e flash.
+
+// Scrive value/10^frac con `digits` decimali (digits <= frac, arrotondato),
+// es. fixed_format(buf, len, 3812, 3, 2) -> "3.81".
+// Ritorna la lunghezza come snprintf, -1 se il buffer non basta.
+int fixed_format(char *buf, size_t len, int32_t value, unsigned frac, unsigned digits);
+
+// Legge "3.8", "-1", "4.215" in unità da 10^-frac (cifre in più arrotondate),
+// es. fixed_parse("3.8", 3, &mv) -> 3800. false se non è un numero.
+bool fixed_parse(const char *s, unsigned frac, int32_t *out);
+
+// Confronto cicli tra il percorso float/printf e quello intero (CONFIG_SOIL_FIXED_POINT_BENCH)
+void fixed_point_bench(void);
@@ -0,0 +1,127 @@
+// health.c
+// Diagnostica di salute del dispositivo: raccolta e formattazione JSON.
+// I contatori cumulativi stanno in RTC (azzerati solo al power-on).
+
+#include "health.h"
+#include "wake_stub.h"
+#include "rtc_clock.h"
+#include "mqtt_wrapper.h"
+#include "esp_attr.h"
+#include "esp_app_desc.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t boots;                          // boot completi (app avviata)
+    uint32_t retries[HEALTH_RETRY_COUNT];    // riconnessioni dal power-on
+    uint16_t since_report;                   // risvegli con radio dall'ultimo messaggio
+} health_rtc_t;
+
+static RTC_DATA_ATTR health_rtc_t st;
+static uint16_t wake_retries[HEALTH_RETRY_COUNT];
+static bool counted = false;
+static bool cycle_counted = false;    // ciclo con radio già contato per health_every
+static bool reset_reported = false;   // messaggio dopo il reset già inviato in questo boot
+
+static const char *reset_name(esp_reset_reason_t r)
+{
+    switch (r) {
+        case ESP_RST_POWERON:   return "poweron";
+        case ESP_RST_EXT:       return "ext";
+        case ESP_RST_SW:        return "sw";
+        case ESP_RST_PANIC:     return "panic";
+        case ESP_RST_INT_WDT:   return "int_wdt";
+        case ESP_RST_TASK_WDT:  return "task_wdt";
+        case ESP_RST_WDT:       return "wdt";
+        case ESP_RST_DEEPSLEEP: return "deepsleep";
+        case ESP_RST_BROWNOUT:  return "brownout";
+        default:                return "unknown";
+    }
+}
+
+static const char *wake_name(esp_sleep_wakeup_cause_t c)
+{
+    switch (c) {
+        case ESP_SLEEP_WAKEUP_TIMER: return "timer";
+        case ESP_SLEEP_WAKEUP_GPIO:  return "gpio";
+        case ESP_SLEEP_WAKEUP_UNDEFINED: return "none";
+        default:                     return "other";
+    }
+}
+
+// byte liberi minimi sullo stack del task (-1 = task non presente)
+static int stack_hwm(const char *task)
+{
+    TaskHandle_t h = xTaskGetHandle(task);
+    return h ? (int)uxTaskGetStackHighWaterMark(h) : -1;
+}
+
+void health_note_retry(health_retry_t what)
+{
+    if (what >= HEALTH_RETRY_COUNT) return;
+    wake_retries[what]++;
+    st.retries[what]++;
+}
+
+bool health_due(unsigned every)
+{
+    if (!counted) {
+        counted = true;
+        st.boots++;
+    }
+    if (!cycle_counted) {
+        cycle_counted = true;
+        st.since_report++;
+    }
+    bool after_reset = esp_reset_reason() != ESP_RST_DEEPSLEEP && !reset_reported;
+    if (after_reset || (every && st.since_report >= every)) {
+        st.since_report = 0;
+        reset_reported = true;
+        return true;
+    }
+    return false;
+}
+
+void health_next_cycle(void)
+{
+    cycle_counted = false;
+    memset(wake_retries, 0, sizeof(wake_retries));
+}
+
+int health_format_json(char *buf, size_t len)
+{
+    wifi_ap_record_t ap = {0};
+    bool assoc = esp_wifi_sta_get_ap_info(&ap) == ESP_OK;
+    int8_t tx_qdbm = 0;  // unità di 0.25 dBm
+    esp_wifi_get_max_tx_power(&tx_qdbm);
+    mqtt_pool_stats_t pool;
+    mqtt_pool_get_stats(&pool);
+
+    return snprintf(buf, len,
+        "{\"reset\":\"%s\",\"wake\":\"%s\","
+        "\"wakes\":%" PRIu32 ",\"boots\":%" PRIu32 ","
+        "\"uptime_s\":%" PRIu32 ",\"awake_ms\":%" PRIu32 ","
+        "\"heap\":%" PRIu32 ",\"heap_min\":%" PRIu32 ","
+        "\"stack\":{\"battery\":%d,\"mqtt\":%d,\"sys_evt\":%d,\"cmd\":%d},"
+        "\"rssi\":%d,\"channel\":%u,\"tx_dbm\":%d.%02d,"
+        "\"retries\":{\"wifi\":%u,\"mqtt\":%u,\"wifi_total\":%" PRIu32 ",\"mqtt_total\":%" PRIu32 "},"
+        "\"pool\":{\"hw\":%u,\"size\":%u,\"inflight_hw\":%u,\"inflight_max\":%u,\"dropped\":%u},"
+        "\"fw\":\"%s\"}",
+        reset_name(esp_reset_reason()), wake_name(esp_sleep_get_wakeup_cause()),
+        wake_stub_total_wakes(), st.boots,
+        (uint32_t)(rtc_clock_now_us() / 1000000ULL), (uint32_t)(esp_timer_get_time() / 1000),
+        esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+        stack_hwm("battery_task"), stack_hwm("mqtt_task"), stack_hwm("sys_evt"), stack_hwm("cmd_task"),
+        assoc ? ap.rssi : 0, assoc ? ap.primary : 0, tx_qdbm / 4, (tx_qdbm % 4) * 25,
+        wake_retries[HEALTH_RETRY_WIFI], wake_retries[HEALTH_RETRY_MQTT],
+        st.retries[HEALTH_RETRY_WIFI], st.retries[HEALTH_RETRY_MQTT],
+        pool.slots_hw, pool.slots, pool.inflight_hw, pool.inflight_max, pool.dropped,
+        esp_app_get_description()->version);
+}
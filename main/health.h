@@ -0,0 +1,23 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    HEALTH_RETRY_WIFI = 0,
+    HEALTH_RETRY_MQTT,
+    HEALTH_RETRY_COUNT
+} health_retry_t;
+
+// da chiamare a ogni tentativo di riconnessione
+void health_note_retry(health_retry_t what);
+
+// true se in questo risveglio va pubblicato il messaggio di salute:
+// ogni `every` risvegli con radio (0 = mai) e sempre dopo un reset non da deep sleep
+bool health_due(unsigned every);
+
+// sessione connessa tra due letture (niente deep sleep): il ciclo successivo
+// conta come un nuovo risveglio con radio
+void health_next_cycle(void);
+
+// JSON con reset/wake, contatori, heap, stack, radio, retry, pool MQTT e versione firmware
+int health_format_json(char *buf, size_t len);
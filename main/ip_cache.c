@@ -0,0 +1,187 @@
+// ip_cache.c
+// Riutilizzo del lease DHCP tra un risveglio e l'altro + IP statico opzionale.
+// Evita DISCOVER/OFFER/REQUEST/ACK (e l'ARP check) finché il lease è valido.
+
+#include "ip_cache.h"
+#include "config.h"
+#include "rtc_clock.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/netif.h"
+#include "lwip/dhcp.h"
+#include <string.h>
+#include <inttypes.h>
+
+#define TAG "IPCACHE"
+
+#define IP_CACHE_MAGIC      0x1EA5E001u
+// margine prima della scadenza (T1) entro cui non riusiamo il lease
+#define IP_CACHE_MARGIN_US  (60ULL * 1000000ULL)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ssid_hash;    // lease valido solo sulla stessa rete
+    uint32_t ip, gw, mask, dns;
+    uint64_t expires_us;   // rtc_clock_now_us() oltre cui serve di nuovo il DHCP
+} ip_lease_cache_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t avg_ms;       // media mobile connect->IP
+} ip_timing_t;
+
+static RTC_DATA_ATTR ip_lease_cache_t lease;
+static RTC_DATA_ATTR ip_timing_t timing[3];
+
+static ip_source_t source = IP_SRC_DHCP;
+static esp_netif_ip_info_t pending_ip;
+static esp_ip4_addr_t pending_dns;
+static int64_t t_start_us = 0;
+
+static const char *source_name(ip_source_t s)
+{
+    switch (s) {
+        case IP_SRC_CACHED: return "cache";
+        case IP_SRC_STATIC: return "static";
+        default:            return "dhcp";
+    }
+}
+
+// FNV-1a, basta per riconoscere un cambio di rete
+static uint32_t ssid_hash(const char *ssid)
+{
+    uint32_t h = 2166136261u;
+    while (*ssid) {
+        h ^= (uint8_t)*ssid++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool load_static(const config_data_t *c)
+{
+    if (c->static_ip[0] == '\0') return false;
+
+    memset(&pending_ip, 0, sizeof(pending_ip));
+    if (esp_netif_str_to_ip4(c->static_ip, &pending_ip.ip) != ESP_OK ||
+        esp_netif_str_to_ip4(c->static_gw, &pending_ip.gw) != ESP_OK ||
+        esp_netif_str_to_ip4(c->static_mask, &pending_ip.netmask) != ESP_OK) {
+        ESP_LOGW(TAG, "Invalid static IP config, falling back to DHCP");
+        return false;
+    }
+    pending_dns = pending_ip.gw;
+    if (c->static_dns[0] != '\0' && esp_netif_str_to_ip4(c->static_dns, &pending_dns) != ESP_OK) {
+        pending_dns = pending_ip.gw;
+    }
+    return true;
+}
+
+static bool load_cached(const config_data_t *c)
+{
+    if (lease.magic != IP_CACHE_MAGIC) return false;
+    if (lease.ssid_hash != ssid_hash(c->wifi_ssid)) return false;
+    if (rtc_clock_now_us() + IP_CACHE_MARGIN_US >= lease.expires_us) {
+        ESP_LOGI(TAG, "Cached lease expired");
+        return false;
+    }
+
+    pending_ip.ip.addr = lease.ip;
+    pending_ip.gw.addr = lease.gw;
+    pending_ip.netmask.addr = lease.mask;
+    pending_dns.addr = lease.dns;
+    return true;
+}
+
+void ip_cache_prepare(esp_netif_t *netif)
+{
+    config_data_t c = config_get();
+
+    t_start_us = esp_timer_get_time();
+    if (load_static(&c)) {
+        source = IP_SRC_STATIC;
+    } else if (load_cached(&c)) {
+        source = IP_SRC_CACHED;
+    } else {
+        source = IP_SRC_DHCP;
+        return;
+    }
+
+    // il client DHCP partirebbe da solo alla connessione
+    esp_netif_dhcpc_stop(netif);
+    ESP_LOGI(TAG, "Using %s IP " IPSTR, source_name(source), IP2STR(&pending_ip.ip));
+}
+
+void ip_cache_on_connected(esp_netif_t *netif)
+{
+    if (source == IP_SRC_DHCP) return;
+
+    esp_netif_dns_info_t dns = {0};
+    dns.ip.type = ESP_IPADDR_TYPE_V4;
+    dns.ip.u_addr.ip4 = pending_dns;
+
+    if (esp_netif_set_ip_info(netif, &pending_ip) != ESP_OK) {
+        ESP_LOGW(TAG, "set_ip_info failed, falling back to DHCP");
+        ip_cache_invalidate(netif);
+        return;
+    }
+    esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+}
+
+void ip_cache_on_got_ip(esp_netif_t *netif)
+{
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - t_start_us) / 1000);
+    ip_timing_t *t = &timing[source];
+    t->avg_ms = (t->count == 0) ? ms : (t->avg_ms * 7 + ms) / 8;
+    if (t->count < UINT32_MAX) t->count++;
+
+    ESP_LOGI(TAG, "Connect->IP via %s: %" PRIu32 " ms (avg dhcp:%" PRIu32 " cache:%" PRIu32 " static:%" PRIu32 ")",
+             source_name(source), ms,
+             timing[IP_SRC_DHCP].avg_ms, timing[IP_SRC_CACHED].avg_ms, timing[IP_SRC_STATIC].avg_ms);
+
+    if (source != IP_SRC_DHCP) return;
+
+    // lease appena ottenuto: lo teniamo fino a T1 (rinnovo), come farebbe il client
+    struct netif *lwip_netif = esp_netif_get_netif_impl(netif);
+    struct dhcp *dhcp = lwip_netif ? netif_dhcp_data(lwip_netif) : NULL;
+    uint32_t valid_s = 0;
+    if (dhcp) {
+        valid_s = dhcp->offered_t1_renew ? dhcp->offered_t1_renew : dhcp->offered_t0_lease / 2;
+    }
+    if (valid_s == 0) {
+        lease.magic = 0;
+        return;
+    }
+
+    esp_netif_ip_info_t ip;
+    esp_netif_dns_info_t dns = {0};
+    esp_netif_get_ip_info(netif, &ip);
+    esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+
+    config_data_t c = config_get();
+    lease.ssid_hash = ssid_hash(c.wifi_ssid);
+    lease.ip = ip.ip.addr;
+    lease.gw = ip.gw.addr;
+    lease.mask = ip.netmask.addr;
+    lease.dns = dns.ip.u_addr.ip4.addr;
+    lease.expires_us = rtc_clock_now_us() + (uint64_t)valid_s * 1000000ULL;
+    lease.magic = IP_CACHE_MAGIC;
+    ESP_LOGI(TAG, "Cached lease " IPSTR " for %" PRIu32 " s", IP2STR(&ip.ip), valid_s);
+}
+
+void ip_cache_invalidate(esp_netif_t *netif)
+{
+    lease.magic = 0;
+    if (source == IP_SRC_CACHED) {
+        // il lease poteva non essere più nostro: si rifà il DHCP al prossimo connect
+        source = IP_SRC_DHCP;
+        t_start_us = esp_timer_get_time();
+        esp_netif_dhcpc_start(netif);
+    }
+}
+
+ip_source_t ip_cache_source(void)
+{
+    return source;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include "esp_netif.h"
+
+typedef enum {
+    IP_SRC_DHCP = 0,
+    IP_SRC_CACHED,   // lease DHCP precedente ancora valido (RTC)
+    IP_SRC_STATIC,   // IP statico da provisioning
+} ip_source_t;
+
+// prima di esp_wifi_connect(): sceglie la sorgente e ferma il client DHCP se non serve
+void ip_cache_prepare(esp_netif_t *netif);
+// su WIFI_EVENT_STA_CONNECTED: applica IP statico/cached (genera IP_EVENT_STA_GOT_IP)
+void ip_cache_on_connected(esp_netif_t *netif);
+// su IP_EVENT_STA_GOT_IP: salva il lease in RTC e logga il tempo connect->IP
+void ip_cache_on_got_ip(esp_netif_t *netif);
+// indirizzo rifiutato (set_ip_info fallito o nessun traffico): scarta il lease e torna al DHCP.
+// Non va chiamata sulle disconnessioni generiche, il lease resta valido.
+void ip_cache_invalidate(esp_netif_t *netif);
+
+ip_source_t ip_cache_source(void);
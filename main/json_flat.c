@@ -0,0 +1,91 @@
+// json_flat.c
+// Scansione di oggetti JSON piatti per i documenti di configurazione via MQTT.
+
+#include "json_flat.h"
+#include <string.h>
+
+static const char *skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+// stringa tra virgolette (p sulla prima); NULL se non chiusa o troppo lunga
+static const char *read_string(const char *p, char *out, size_t len)
+{
+    size_t n = 0;
+    for (p++; *p && *p != '"'; p++) {
+        char c = *p;
+        if (c == '\\') {
+            c = *++p;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '"': case '\\': case '/': break;
+                default: return NULL;  // \u e simili: non servono qui
+            }
+        }
+        if (n + 1 >= len) return NULL;
+        out[n++] = c;
+    }
+    if (*p != '"') return NULL;
+    out[n] = '\0';
+    return p + 1;
+}
+
+// numero o letterale (true/false/null) copiato così com'è
+static const char *read_bare(const char *p, char *out, size_t len)
+{
+    size_t n = 0;
+    while (*p && strchr(",} \t\r\n", *p) == NULL) {
+        if (*p == '{' || *p == '[' || *p == '"' || n + 1 >= len) return NULL;
+        out[n++] = *p++;
+    }
+    if (n == 0) return NULL;
+    out[n] = '\0';
+    return p;
+}
+
+void json_flat_init(json_flat_t *it, const char *doc)
+{
+    it->p = skip_ws(doc);
+    it->error = *it->p != '{';
+    it->string = false;
+    it->pair = false;
+    if (!it->error) it->p++;
+}
+
+bool json_flat_next(json_flat_t *it, char *key, size_t key_len, char *val, size_t val_len)
+{
+    if (it->error || !it->p) return false;
+
+    const char *p = skip_ws(it->p);
+    if (*p == '}') {
+        if (*skip_ws(p + 1)) goto fail;  // dopo l'oggetto solo spazi
+        it->p = NULL;  // fine oggetto
+        return false;
+    }
+    if (it->pair) {
+        if (*p != ',') goto fail;
+        p = skip_ws(p + 1);
+    }
+
+    if (*p != '"' || !(p = read_string(p, key, key_len))) goto fail;
+    p = skip_ws(p);
+    if (*p != ':') goto fail;
+    p = skip_ws(p + 1);
+    it->string = *p == '"';
+    p = it->string ? read_string(p, val, val_len) : read_bare(p, val, val_len);
+    if (!p) goto fail;
+
+    p = skip_ws(p);
+    if (*p != ',' && *p != '}') goto fail;
+    it->p = p;
+    it->pair = true;
+    return true;
+
+fail:
+    it->error = true;
+    return false;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lettura di oggetti JSON piatti {"chiave": valore, ...} senza allocazioni:
+// valori numero, stringa, true/false/null; oggetti e array annidati sono un errore.
+// Basta per i documenti di configurazione, senza portarsi dietro cJSON e l'heap.
+
+typedef struct {
+    const char *p;
+    bool error;     // documento non valido (le coppie già lette restano valide)
+    bool string;    // l'ultimo valore letto era tra virgolette ("null" non è null)
+    bool pair;      // letta almeno una coppia: la successiva va preceduta da ','
+} json_flat_t;
+
+void json_flat_init(json_flat_t *it, const char *doc);
+
+// Legge la coppia successiva: stringhe senza virgolette e con gli escape
+// risolti, numeri e letterali come testo. false a fine oggetto o su errore
+// (anche virgole fuori posto o testo dopo la '}' finale).
+bool json_flat_next(json_flat_t *it, char *key, size_t key_len, char *val, size_t val_len);
@@ -0,0 +1,130 @@
+// latency_hist.c
+// Istogrammi delle latenze di connessione accumulati in RTC tra i risvegli,
+// inviati come riepilogo una volta per periodo (es. al giorno) e poi azzerati.
+
+#include "latency_hist.h"
+#include "wake_trace.h"
+#include "rtc_clock.h"
+#include "esp_attr.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LAT_HIST_MAGIC 0x4157E029u
+
+typedef struct {
+    uint32_t magic;
+    uint64_t period_start_us;                  // rtc_clock_now_us()
+    uint16_t bucket[LAT_COUNT][LAT_BUCKETS];
+} latency_hist_t;
+
+static const char *const metric_names[LAT_COUNT] = { "assoc", "dhcp", "mqtt", "puback" };
+
+static RTC_DATA_ATTR latency_hist_t hist;
+static bool wake_recorded = false;
+
+static void ensure_init(void)
+{
+    if (hist.magic != LAT_HIST_MAGIC) {
+        latency_hist_reset();
+    }
+}
+
+static uint32_t bucket_upper_ms(int i)
+{
+    return 4u << i;
+}
+
+static int bucket_of(uint32_t ms)
+{
+    for (int i = 0; i < LAT_BUCKETS - 1; i++) {
+        if (ms <= bucket_upper_ms(i)) return i;
+    }
+    return LAT_BUCKETS - 1;
+}
+
+void latency_hist_record(latency_metric_t m, uint32_t ms)
+{
+    if (m >= LAT_COUNT) return;
+    ensure_init();
+
+    uint16_t *b = hist.bucket[m];
+    int i = bucket_of(ms);
+    if (b[i] == UINT16_MAX) {
+        // contatore saturo: dimezza tutta la metrica, la distribuzione resta valida
+        for (int k = 0; k < LAT_BUCKETS; k++) b[k] /= 2;
+    }
+    b[i]++;
+}
+
+static void record_span(latency_metric_t m, wake_phase_t from, wake_phase_t to)
+{
+    uint32_t a = wake_trace_get_us(from);
+    uint32_t b = wake_trace_get_us(to);
+    if (a && b && b >= a) latency_hist_record(m, (b - a) / 1000);
+}
+
+void latency_hist_record_wake(void)
+{
+    if (wake_recorded) return;
+    wake_recorded = true;
+
+    record_span(LAT_WIFI_ASSOC, WT_WIFI_START, WT_WIFI_ASSOC);
+    record_span(LAT_DHCP, WT_WIFI_ASSOC, WT_GOT_IP);
+    record_span(LAT_MQTT_CONNECT, WT_GOT_IP, WT_MQTT_CONNECTED);
+}
+
+bool latency_hist_flush_due(uint16_t period_h)
+{
+    ensure_init();
+    if (period_h == 0) return false;
+    return rtc_clock_now_us() - hist.period_start_us >= (uint64_t)period_h * 3600ULL * 1000000ULL;
+}
+
+// limite superiore (ms) del bucket che contiene il quantile q/100
+static uint32_t percentile_ms(const uint16_t *b, uint32_t n, uint32_t q)
+{
+    uint32_t target = (n * q + 99) / 100;
+    uint32_t cum = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        cum += b[i];
+        if (cum >= target && cum > 0) return bucket_upper_ms(i);
+    }
+    return 0;
+}
+
+int latency_hist_format(char *buf, size_t len)
+{
+    ensure_init();
+    if (len == 0) return 0;
+
+    size_t n = 0;
+    n += snprintf(buf + n, len - n, "{");
+    for (int m = 0; m < LAT_COUNT && n < len; m++) {
+        const uint16_t *b = hist.bucket[m];
+        uint32_t count = 0;
+        int last = -1;
+        for (int i = 0; i < LAT_BUCKETS; i++) {
+            count += b[i];
+            if (b[i]) last = i;
+        }
+        n += snprintf(buf + n, len - n, "%s\"%s\":{\"n\":%lu,\"p\":[%lu,%lu,%lu],\"b\":[",
+                      m ? "," : "", metric_names[m], (unsigned long)count,
+                      (unsigned long)percentile_ms(b, count, 50),
+                      (unsigned long)percentile_ms(b, count, 95),
+                      (unsigned long)percentile_ms(b, count, 99));
+        // i bucket vuoti in coda sono omessi
+        for (int i = 0; i <= last && n < len; i++) {
+            n += snprintf(buf + n, len - n, "%s%u", i ? "," : "", b[i]);
+        }
+        if (n < len) n += snprintf(buf + n, len - n, "]}");
+    }
+    if (n < len) n += snprintf(buf + n, len - n, "}");
+    return (int)(n < len ? n : len - 1);
+}
+
+void latency_hist_reset(void)
+{
+    memset(&hist, 0, sizeof(hist));
+    hist.period_start_us = rtc_clock_now_us();
+    hist.magic = LAT_HIST_MAGIC;
+}
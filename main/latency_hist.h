@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    LAT_WIFI_ASSOC = 0,  // avvio Wi-Fi -> associato
+    LAT_DHCP,            // associato -> IP (DHCP, lease in cache o statico)
+    LAT_MQTT_CONNECT,    // IP -> CONNACK
+    LAT_PUBACK,          // publish -> PUBACK
+    LAT_COUNT
+} latency_metric_t;
+
+// Bucket in scala log2: il bucket i copre fino a 4<<i ms, l'ultimo è overflow
+#define LAT_BUCKETS 16
+
+void latency_hist_record(latency_metric_t m, uint32_t ms);
+
+// Registra le latenze di connessione del risveglio corrente dalla wake_trace
+// (una sola volta per boot)
+void latency_hist_record_wake(void);
+
+// true se il periodo configurato (ore) è trascorso e il riepilogo va inviato
+bool latency_hist_flush_due(uint16_t period_h);
+
+// Riepilogo compatto JSON (n, p50/p95/p99 in ms, bucket) per tutte le metriche
+int latency_hist_format(char *buf, size_t len);
+
+// Azzera gli istogrammi e apre un nuovo periodo
+void latency_hist_reset(void);
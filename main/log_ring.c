@@ -0,0 +1,162 @@
+// log_ring.c
+// Sostituisce la scrittura sincrona su UART (esp_log_set_vprintf): ogni record
+// viene formattato in un ring buffer in RTC, senza attese sulla seriale.
+// I livelli sotto CONFIG_LOG_MAXIMUM_LEVEL non vengono nemmeno compilati.
+
+#include "log_ring.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_RING_MAGIC   0x106A0039u
+#define LOG_LINE_MAX     160
+#define LOG_LEVELS_MAX   4
+#define LOG_TAG_MAX      16
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;         // prossima posizione di scrittura
+    uint16_t used;         // byte occupati
+    uint16_t dropped;      // record scartati (i più vecchi) per fare spazio
+    uint8_t  error;        // errore registrato dall'ultimo svuotamento
+    char     data[CONFIG_SOIL_LOG_RING_SIZE];
+} log_ring_t;
+
+typedef struct {
+    char    tag[LOG_TAG_MAX];
+    uint8_t level;
+} log_level_entry_t;
+
+static RTC_DATA_ATTR log_ring_t ring;
+static RTC_DATA_ATTR log_level_entry_t levels[LOG_LEVELS_MAX];
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static vprintf_like_t uart_vprintf = NULL;
+
+// scarta la riga più vecchia (fino al primo '\n' compreso)
+static void drop_oldest(void)
+{
+    uint16_t tail = (ring.head + CONFIG_SOIL_LOG_RING_SIZE - ring.used) % CONFIG_SOIL_LOG_RING_SIZE;
+    while (ring.used > 0) {
+        char c = ring.data[tail];
+        tail = (tail + 1) % CONFIG_SOIL_LOG_RING_SIZE;
+        ring.used--;
+        if (c == '\n') break;
+    }
+    if (ring.dropped < UINT16_MAX) ring.dropped++;
+}
+
+static void append(const char *s, size_t n)
+{
+    portENTER_CRITICAL(&ring_lock);
+    while ((size_t)(CONFIG_SOIL_LOG_RING_SIZE - ring.used) < n) drop_oldest();
+    for (size_t i = 0; i < n; i++) {
+        ring.data[ring.head] = s[i];
+        ring.head = (ring.head + 1) % CONFIG_SOIL_LOG_RING_SIZE;
+    }
+    ring.used += n;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+static int ring_vprintf(const char *fmt, va_list args)
+{
+#if CONFIG_SOIL_LOG_RING_UART
+    if (uart_vprintf) {
+        va_list copy;
+        va_copy(copy, args);
+        uart_vprintf(fmt, copy);
+        va_end(copy);
+    }
+#endif
+    char line[LOG_LINE_MAX];
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    if (n <= 0) return n;
+    size_t len = (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1;
+
+    // via i codici colore (CONFIG_LOG_COLORS): "\033[0;31mE (..." ... "\033[0m\n"
+    char *p = line;
+    if (*p == '\033') {
+        char *m = memchr(p, 'm', len);
+        if (m) {
+            len -= (size_t)(m + 1 - p);
+            p = m + 1;
+        }
+    }
+    if (len >= 5 && memcmp(p + len - 5, "\033[0m", 4) == 0) {
+        p[len - 5] = '\n';
+        len -= 4;
+    }
+    if (len == 0) return n;
+    if (p[len - 1] != '\n') {
+        if (len == sizeof(line) - 1) p[len - 1] = '\n';  // riga troncata
+        else p[len++] = '\n';
+    }
+
+    if (p[0] == 'E') ring.error = 1;
+    append(p, len);
+    return n;
+}
+
+static void apply_levels(void)
+{
+    for (int i = 0; i < LOG_LEVELS_MAX; i++) {
+        if (levels[i].tag[0]) esp_log_level_set(levels[i].tag, (esp_log_level_t)levels[i].level);
+    }
+}
+
+void log_ring_init(void)
+{
+    if (ring.magic != LOG_RING_MAGIC) {
+        memset(&ring, 0, sizeof(ring));
+        memset(levels, 0, sizeof(levels));
+        ring.magic = LOG_RING_MAGIC;
+    }
+    apply_levels();
+    uart_vprintf = esp_log_set_vprintf(ring_vprintf);
+}
+
+bool log_ring_has_error(void)
+{
+    return ring.error != 0;
+}
+
+size_t log_ring_read(char *buf, size_t len)
+{
+    size_t n = 0, last_nl = 0;
+
+    portENTER_CRITICAL(&ring_lock);
+    uint16_t tail = (ring.head + CONFIG_SOIL_LOG_RING_SIZE - ring.used) % CONFIG_SOIL_LOG_RING_SIZE;
+    while (n < len && n < ring.used) {
+        buf[n] = ring.data[(tail + n) % CONFIG_SOIL_LOG_RING_SIZE];
+        if (buf[n++] == '\n') last_nl = n;
+    }
+    ring.used -= last_nl;
+    if (ring.used == 0) ring.error = 0;
+    portEXIT_CRITICAL(&ring_lock);
+
+    return last_nl;
+}
+
+unsigned log_ring_take_dropped(void)
+{
+    unsigned d = ring.dropped;
+    ring.dropped = 0;
+    return d;
+}
+
+bool log_ring_set_level(const char *tag, esp_log_level_t level)
+{
+    if (tag[0] == '\0' || strlen(tag) >= LOG_TAG_MAX) return false;
+
+    int slot = -1;
+    for (int i = 0; i < LOG_LEVELS_MAX; i++) {
+        if (strcmp(levels[i].tag, tag) == 0) { slot = i; break; }
+        if (slot < 0 && levels[i].tag[0] == '\0') slot = i;
+    }
+    if (slot < 0) return false;
+
+    strcpy(levels[slot].tag, tag);
+    levels[slot].level = (uint8_t)level;
+    esp_log_level_set(tag, level);
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_log.h"
+
+// Backend di log su ring buffer in RTC: i record formattati restano in memoria
+// tra un risveglio e l'altro e vengono inviati via MQTT su richiesta o dopo un errore.
+
+// da chiamare all'inizio di app_main: installa il backend e riapplica i livelli
+void log_ring_init(void);
+
+// true se dall'ultimo svuotamento è stato registrato un errore (ESP_LOGE)
+bool log_ring_has_error(void);
+
+// copia e rimuove i record più vecchi (solo righe intere), ritorna i byte copiati
+size_t log_ring_read(char *buf, size_t len);
+
+// record persi per mancanza di spazio dall'ultimo svuotamento (azzera il contatore)
+unsigned log_ring_take_dropped(void);
+
+// livello per tag ("*" = tutti), conservato in RTC e riapplicato a ogni risveglio
+bool log_ring_set_level(const char *tag, esp_log_level_t level);
@@ -0,0 +1,124 @@
+// moisture_trend.c
+// Predice quando l'umidità uscirà dalla banda morta (o supererà la soglia
+// utente) e programma il risveglio per quel momento.
+
+#include "moisture_trend.h"
+#include "config.h"
+#include "rtc_clock.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define TAG "TREND"
+
+#define TREND_MAGIC     0x7E4D0032u
+#define TREND_SAMPLES   8
+#define TREND_MIN_FIT   3       // campioni minimi per una stima
+#define TREND_MIN_SPAN_S 600    // ...distribuiti su almeno 10 minuti
+
+typedef struct {
+    uint32_t magic;
+    uint8_t  head;              // prossima posizione da scrivere
+    uint8_t  count;
+    uint32_t t_s[TREND_SAMPLES];    // rtc_clock in secondi
+    uint16_t pm[TREND_SAMPLES];     // umidità in per-mille
+} trend_ring_t;
+
+static RTC_DATA_ATTR trend_ring_t ring;
+
+void moisture_trend_add(int pm)
+{
+    if (pm < 0) return;
+    if (ring.magic != TREND_MAGIC) {
+        ring.magic = TREND_MAGIC;
+        ring.head = 0;
+        ring.count = 0;
+    }
+
+    if (pm > 1000) pm = 1000;
+    ring.t_s[ring.head] = (uint32_t)(rtc_clock_now_us() / 1000000ULL);
+    ring.pm[ring.head] = (uint16_t)pm;
+    ring.head = (ring.head + 1) % TREND_SAMPLES;
+    if (ring.count < TREND_SAMPLES) ring.count++;
+}
+
+static int last_index(void)
+{
+    return (ring.head + TREND_SAMPLES - 1) % TREND_SAMPLES;
+}
+
+// minimi quadrati con tempi relativi all'ultimo campione: pendenza = num/den (pm/s)
+static bool fit(int64_t *num, int64_t *den)
+{
+    if (ring.magic != TREND_MAGIC || ring.count < TREND_MIN_FIT) return false;
+
+    int last = last_index();
+    int64_t sx = 0, sy = 0;
+    for (int k = 0; k < ring.count; k++) {
+        int i = (last + TREND_SAMPLES - k) % TREND_SAMPLES;
+        sx += (int64_t)ring.t_s[i] - ring.t_s[last];
+        sy += ring.pm[i];
+    }
+    int64_t n = ring.count;
+    int64_t sxy = 0, sxx = 0;
+    for (int k = 0; k < ring.count; k++) {
+        int i = (last + TREND_SAMPLES - k) % TREND_SAMPLES;
+        int64_t dx = ((int64_t)ring.t_s[i] - ring.t_s[last]) * n - sx;   // x scalato per n
+        int64_t dy = (int64_t)ring.pm[i] * n - sy;
+        sxy += dx * dy;
+        sxx += dx * dx;
+    }
+    int oldest = (ring.head + TREND_SAMPLES - ring.count) % TREND_SAMPLES;
+    if (ring.t_s[last] - ring.t_s[oldest] < TREND_MIN_SPAN_S || sxx == 0) return false;
+
+    *num = sxy;
+    *den = sxx;
+    return true;
+}
+
+int32_t moisture_trend_slope_pm_h(void)
+{
+    int64_t num, den;
+    if (!fit(&num, &den)) return 0;
+    return (int32_t)(num * 3600 / den);
+}
+
+uint32_t moisture_trend_next_s(void)
+{
+    config_data_t c = config_get();
+    if (!c.trend_enabled) return 0;
+
+    uint32_t min_s = (uint32_t)c.trend_min_minutes * 60;
+    uint32_t max_s = (uint32_t)c.trend_max_minutes * 60;
+    if (max_s < min_s) max_s = min_s;
+
+    int64_t num, den;
+    if (!fit(&num, &den)) return 0;
+
+    // stabile: nessun attraversamento prevedibile
+    uint64_t next = max_s;
+    if (num != 0) {
+        uint64_t abs_num = (uint64_t)(num < 0 ? -num : num);
+
+        // tempo per spostarsi di una banda morta
+        uint64_t t_band = (uint64_t)c.trend_deadband_pm * (uint64_t)den / abs_num;
+        if (t_band < next) next = t_band;
+
+        // tempo per raggiungere la soglia utente, se ci stiamo andando incontro
+        if (c.trend_threshold_pm > 0) {
+            int32_t gap = (int32_t)c.trend_threshold_pm - ring.pm[last_index()];
+            if (gap != 0 && ((gap > 0) == (num > 0))) {
+                uint64_t t_thr = (uint64_t)(gap < 0 ? -gap : gap) * (uint64_t)den / abs_num;
+                if (t_thr < next) next = t_thr;
+            }
+        }
+    }
+
+    if (next < min_s) next = min_s;
+    if (next > max_s) next = max_s;
+
+    ESP_LOGI(TAG, "Slope %" PRIi32 " pm/h -> next wake in %" PRIu32 " s",
+             moisture_trend_slope_pm_h(), (uint32_t)next);
+    return (uint32_t)next;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// Stima della tendenza dell'umidità (regressione lineare sulle ultime
+// letture in RTC) per decidere quando risvegliarsi la prossima volta.
+
+// registra una lettura (umidità in per-mille) con il tempo RTC corrente
+void moisture_trend_add(int pm);
+
+// pendenza stimata in per-mille/ora (0 se dati insufficienti)
+int32_t moisture_trend_slope_pm_h(void);
+
+// prossimo intervallo in secondi, già limitato tra min e max configurati;
+// 0 = trend disattivato o dati insufficienti (usare sleep_minutes)
+uint32_t moisture_trend_next_s(void);
@@ -16,13 +16,47 @@
 #include "esp_mac.h"
 #include <stdio.h>         // snprintf
 #include <string.h>        // memcpy, strcmp, strncmp
-#include <stdlib.h>        // atoi, strtof
+#include <stdlib.h>        // strtol
+#include <errno.h>
 #include "sensor.h"
+#include "broker_cache.h"
+#include "wake_trace.h"
+#include "latency_hist.h"
+#include "energy.h"
+#include "sleep_control.h"
+#include "esp_random.h"
+#include "rtc_clock.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "log_ring.h"
+#include "health.h"
+#include "esp_app_desc.h"
+#include "cmd_worker.h"
+#include "fixed_point.h"
+#include "discovery_entities.h"
+#include "json_flat.h"
+#include "setting_owner.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 
 #ifndef MIN
 #define MIN(a,b) ((a)<(b)?(a):(b))
 #endif
 
+/**
+ * @brief MQTT client buffers and task stack, allocated once in start_mqtt()
+ * @details Worst case out: a full pool slot (latency summary, <= 640 B) +
+ *          topic (<= 128 B) + fixed header. Worst case in: config/desired topic
+ *          (<= 128 B) + document (< CONFIG_DOC_MAX). Longer messages arrive
+ *          from esp-mqtt in chunks and are rejected.
+ */
+#define MQTT_BUF_OUT     800
+#define MQTT_BUF_IN      672
+#define CONFIG_DOC_MAX   512
+#define MQTT_TASK_STACK  6144
+
 /** @brief Tag for logging */
 static const char *TAG = "MQTT";
 
@@ -44,6 +78,9 @@ static char topic_battery[128] = {0};
 /** @brief MQTT topic for publishing battery percentage (computed) */
 static char topic_battery_pct[128] = {0};
 
+/** @brief MQTT topic for the timestamped reading (JSON with epoch time and time quality) */
+static char topic_reading[128] = {0};
+
 /** @brief MQTT topic for receiving sleep interval settings */
 static char topic_set[128] = {0};
 
@@ -56,20 +93,1067 @@ static char topic_set_vmin[128], topic_set_vmax[128], topic_set_wet[128], topic_
 /** @brief MQTT topics for publishing current calibration parameters (retain) */
 static char topic_batt_vmin_state[128], topic_batt_vmax_state[128], topic_soil_wet_state[128], topic_soil_dry_state[128];
 
-/** @brief MQTT topic for receiving calibration command for humidity sensor (optional, not handled here) */
+/** @brief MQTT topics for the wet/dry calibration commands (run by the command worker) */
 static char topic_cmd_mark_wet[128], topic_cmd_mark_dry[128];
 
-/** @brief helper: compute battery % from voltage and current config (clamped 0..100) */
-uint8_t batt_percent_from_v(float v)
+/** @brief MQTT topic for command completion reports */
+static char topic_cmd_result[128];
+
+/** @brief MQTT topics for previous wake-cycle diagnostics (timeline + total awake time) */
+static char topic_diag_timeline[128], topic_awake_ms[128];
+
+/** @brief MQTT topics for the periodic latency histogram summary and its period (hours) */
+static char topic_diag_latency[128], topic_set_hist_period[128], topic_hist_period_state[128];
+
+/** @brief MQTT topics for the energy model: estimates, per-state currents (set + retained echo) */
+static char topic_energy_mah_day[128], topic_batt_days_left[128];
+static char topic_set_energy_model[128], topic_energy_model_state[128];
+
+/** @brief MQTT topics for the battery sleep policy: active tier, curve (set + retained echo) */
+static char topic_policy_tier[128], topic_set_batt_policy[128], topic_batt_policy_state[128];
+
+/** @brief MQTT topics for predictive wake scheduling settings (set + retained echo) */
+static char topic_set_trend[128], topic_trend_state[128];
+
+/** @brief MQTT topics for the wake slot offset within the interval (set + retained echo) */
+static char topic_set_wake_slot[128], topic_wake_slot_state[128];
+
+/** @brief MQTT topics for the RTC log ring (flush output, flush command, per-tag levels) */
+static char topic_diag_log[128], topic_cmd_log_flush[128], topic_set_log_level[128];
+
+/** @brief MQTT topics for device health diagnostics (retained JSON + report period) */
+static char topic_diag_health[128], topic_set_health_every[128], topic_health_every_state[128];
+
+/** @brief MQTT topics for wake-stub-only cycles between full readings (set + retained echo) */
+static char topic_set_stub_skip[128], topic_stub_skip_state[128];
+
+/** @brief MQTT topics for the HA discovery mode, "entity" or "device" (set + retained echo) */
+static char topic_set_disc_mode[128], topic_disc_mode_state[128];
+
+/** @brief MQTT topic for availability: online / sleeping / offline (last will), retained */
+static char topic_availability[128];
+
+/** @brief MQTT topics for the configuration documents (desired: retained input, reported: output) */
+static char topic_config_desired[128], topic_config_reported[128];
+
+/** @brief MQTT topics for the group name (set + retained echo) */
+static char topic_set_group[128], topic_group_state[128];
+
+/** @brief MQTT topics for the connected sleep mode (set + retained echo) */
+static char topic_set_conn_sleep[128], topic_conn_sleep_state[128];
+
+/**
+ * @brief Fleet configuration documents, same format as config/desired
+ * @details soil_sensor/all/config/desired reaches every sensor,
+ *          soil_sensor/group/<group>/config/desired the sensors of one group.
+ *          The group topic follows the group setting (guarded by desired_lock).
+ */
+static char topic_all_desired[64], topic_group_desired[128];
+
+/** @brief Set topic of each setting; config/desired uses cmd_name() as key */
+static char *const setting_topic[CMD_SETTINGS_END] = {
+    [CMD_SET_SLEEP]        = topic_set,
+    [CMD_SET_VMIN]         = topic_set_vmin,
+    [CMD_SET_VMAX]         = topic_set_vmax,
+    [CMD_SET_WET]          = topic_set_wet,
+    [CMD_SET_DRY]          = topic_set_dry,
+    [CMD_SET_HIST_PERIOD]  = topic_set_hist_period,
+    [CMD_SET_ENERGY_MODEL] = topic_set_energy_model,
+    [CMD_SET_BATT_POLICY]  = topic_set_batt_policy,
+    [CMD_SET_TREND]        = topic_set_trend,
+    [CMD_SET_WAKE_SLOT]    = topic_set_wake_slot,
+    [CMD_SET_STUB_SKIP]    = topic_set_stub_skip,
+    [CMD_SET_HEALTH_EVERY] = topic_set_health_every,
+    [CMD_SET_DISC_MODE]    = topic_set_disc_mode,
+    [CMD_SET_GROUP]        = topic_set_group,
+    [CMD_SET_CONN_SLEEP]   = topic_set_conn_sleep,
+};
+
+/** @brief Scope of a configuration document, from the lowest precedence */
+typedef enum {
+    DOC_ALL = 0,
+    DOC_GROUP,
+    DOC_DEVICE,
+    DOC_COUNT
+} doc_scope_t;
+
+/** @brief Last document of each scope, handed from the MQTT task to the worker */
+static char desired_doc[DOC_COUNT][CONFIG_DOC_MAX];
+static portMUX_TYPE desired_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Message IDs and send times of the last telemetry burst, for PUBACK latency
+ * @details Written when the message is actually handed to esp-mqtt, directly
+ *          or later from the pool (see mqtt_pub_tracked()).
+ */
+#define TELEMETRY_MSGS 3
+static int telemetry_msg_id[TELEMETRY_MSGS] = {-1, -1, -1};
+static int64_t telemetry_sent_us[TELEMETRY_MSGS];
+
+/** @brief True once the current client has reached MQTT_EVENT_CONNECTED */
+static bool mqtt_ever_connected = false;
+
+/** @brief Discovery entity: HA component, object ID, unique_id suffix, expire_after flag, entity fields */
+typedef struct {
+    const char *component;
+    const char *object;
+    const char *unique;
+    bool expires;           /**< refreshed on every wake with radio: gets expire_after */
+    const char *fields;
+} disc_entity_t;
+
+#define DISC_ENTITY(comp, obj, uid, exp, fields) { #comp, #obj, #uid, exp, fields },
+static const disc_entity_t disc_entities[] = { DISCOVERY_ENTITIES(DISC_ENTITY) };
+
+/** @brief Session state bits: connected, connect-time burst already sent in this wake */
+static StaticEventGroup_t session_bits_buf;
+static EventGroupHandle_t session_bits = NULL;
+#define SESSION_CONNECTED_BIT  BIT0
+static bool session_published = false;
+
+/** @brief Clean disconnect before deep sleep in progress (not a retry) */
+static bool mqtt_closing = false;
+
+/**
+ * @brief Availability payloads on soil_sensor/<id>/availability (retained)
+ * @details "offline" is the last will, sent by the broker if the device drops
+ *          without a DISCONNECT. "sleeping" is not an HA availability payload,
+ *          so entities stay available while the device sleeps and expire_after
+ *          flags readings that stop arriving.
+ */
+#define AVAIL_ONLINE   "online"
+#define AVAIL_OFFLINE  "offline"
+#define AVAIL_SLEEPING "sleeping"
+
+/**
+ * @brief Size of the device-level discovery payload, computed from the table
+ * @details Head: "~", availability, device and origin blocks (firmware
+ *          version <= 32 chars). Per component: key, "p", fields, unique_id
+ *          and expire_after.
+ */
+#define DISC_DEVICE_HEAD 352
+#define DISC_DEVICE_CMP(comp, obj, uid, exp, fields) + sizeof(fields) + 2 * sizeof(#uid) + sizeof(#comp) + 72
+#define DISC_DEVICE_MAX (DISC_DEVICE_HEAD DISCOVERY_ENTITIES(DISC_DEVICE_CMP))
+
+/**
+ * @brief Publish pool limits
+ * @details At most MQTT_MAX_INFLIGHT QoS1 publishes are handed to esp-mqtt
+ *          (and held in its heap outbox) before their PUBACK; the rest wait in
+ *          MQTT_POOL_SLOTS preallocated slots. The outbox limit is a hard cap
+ *          on top of that, with room for the device-level discovery config
+ *          (sent alone, see mqtt_publish_discovery_device()).
+ */
+#define MQTT_MAX_INFLIGHT   4
+#define MQTT_POOL_SLOTS     8
+#define MQTT_POOL_TOPIC     128
+#define MQTT_POOL_PAYLOAD   640
+#define MQTT_POOL_WAIT_MS   3000
+#define MQTT_OUTBOX_LIMIT   (MQTT_MAX_INFLIGHT * (MQTT_POOL_TOPIC + MQTT_POOL_PAYLOAD + 32) + DISC_DEVICE_MAX)
+
+/** @brief A publish waiting for an in-flight slot */
+typedef struct {
+    char topic[MQTT_POOL_TOPIC];
+    char data[MQTT_POOL_PAYLOAD];
+    uint16_t len;
+    uint8_t qos;
+    bool retain;
+    int8_t track;           /**< telemetry index for PUBACK latency, -1 = none */
+    volatile bool ready;    /**< copy completed, can be sent */
+} mqtt_slot_t;
+
+/** @brief Slots used as a ring: waiting messages are sent in order */
+static mqtt_slot_t pool[MQTT_POOL_SLOTS];
+static uint8_t pool_head = 0, pool_count = 0;
+static uint8_t inflight = 0;
+static mqtt_pool_stats_t pool_stats;
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static StaticSemaphore_t pool_free_buf;
+static SemaphoreHandle_t pool_free = NULL;   /**< counts free slots */
+static TaskHandle_t mqtt_task = NULL;        /**< set on the first MQTT event */
+
+/** @brief Count a dropped publish (any task) */
+static void mqtt_pool_count_drop(void)
 {
-    config_data_t c = config_get();
-    float denom = (c.batt_v_max - c.batt_v_min);
-    float p = (denom > 0.001f) ? (v - c.batt_v_min) / denom : 0.0f;
-    if (p < 0.0f) p = 0.0f;
-    if (p > 1.0f) p = 1.0f;
-    uint8_t pct = (unsigned)(p * 100.0f + 0.5f);
-    if (pct > 100u) pct = 100u;
-    return pct;
+    portENTER_CRITICAL(&pool_lock);
+    pool_stats.dropped++;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+/**
+ * @brief Hand a QoS1 message to esp-mqtt, recording the ID of tracked telemetry
+ * @details Called from whichever task sends (caller or pool pump), so queued
+ *          telemetry is timed from the moment it actually leaves the pool.
+ *          A PUBACK processed before the ID is stored is not counted.
+ */
+static int mqtt_send(const char *topic, const char *data, int len, int qos, bool retain, int track)
+{
+    if (track >= 0) {
+        telemetry_msg_id[track] = -1;
+        telemetry_sent_us[track] = esp_timer_get_time();
+    }
+    int id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+    if (track >= 0) telemetry_msg_id[track] = id;
+    return id;
+}
+
+/**
+ * @brief Send a message already counted in flight; undo the count if refused
+ */
+static int mqtt_send_counted(const char *topic, const char *data, int len, int qos, bool retain, int track)
+{
+    int id = mqtt_send(topic, data, len, qos, retain, track);
+    if (id < 0) {
+        portENTER_CRITICAL(&pool_lock);
+        inflight--;
+        pool_stats.dropped++;
+        portEXIT_CRITICAL(&pool_lock);
+    }
+    return id;
+}
+
+/**
+ * @brief Send waiting messages while in-flight slots are available
+ * @details The head slot is released (semaphore given) only after esp-mqtt has
+ *          copied it, so a producer can never overwrite a message being sent.
+ */
+static void mqtt_pool_pump(void)
+{
+    for (;;) {
+        portENTER_CRITICAL(&pool_lock);
+        if (inflight >= MQTT_MAX_INFLIGHT || pool_count == 0 || !pool[pool_head].ready) {
+            portEXIT_CRITICAL(&pool_lock);
+            return;
+        }
+        mqtt_slot_t *s = &pool[pool_head];
+        pool_head = (pool_head + 1) % MQTT_POOL_SLOTS;
+        pool_count--;
+        inflight++;
+        portEXIT_CRITICAL(&pool_lock);
+
+        mqtt_send_counted(s->topic, s->data, s->len, s->qos, s->retain, s->track);
+        s->ready = false;
+        xSemaphoreGive(pool_free);
+    }
+}
+
+/**
+ * @brief Claim the next pool slot, in order, for the caller to fill
+ * @details The slot stays not ready (and blocks the slots after it) until
+ *          mqtt_pool_commit(). Blocks up to @p wait for a free slot.
+ * @return Slot, or NULL (counted as dropped) if none became free
+ */
+static mqtt_slot_t *mqtt_pool_reserve(TickType_t wait)
+{
+    if (xSemaphoreTake(pool_free, wait) != pdTRUE) {
+        mqtt_pool_count_drop();
+        return NULL;
+    }
+    portENTER_CRITICAL(&pool_lock);
+    mqtt_slot_t *s = &pool[(pool_head + pool_count) % MQTT_POOL_SLOTS];
+    s->track = -1;
+    pool_count++;
+    if (pool_count > pool_stats.slots_hw) pool_stats.slots_hw = pool_count;
+    portEXIT_CRITICAL(&pool_lock);
+    return s;
+}
+
+/**
+ * @brief Mark a reserved slot (topic and data already written) ready to send
+ */
+static void mqtt_pool_commit(mqtt_slot_t *s, size_t len, int qos, bool retain)
+{
+    s->len = (uint16_t)len;
+    s->qos = (uint8_t)qos;
+    s->retain = retain;
+    s->ready = true;
+    mqtt_pool_pump();  /* an ack may have arrived while copying */
+}
+
+/**
+ * @brief Publish through the bounded pool
+ * @details Same arguments as esp_mqtt_client_publish() without the client.
+ *          QoS0 goes straight out. QoS1 goes out directly while fewer than
+ *          MQTT_MAX_INFLIGHT are unacknowledged, otherwise it is copied into a
+ *          pool slot and sent when a PUBACK frees room. With the pool full the
+ *          caller blocks up to MQTT_POOL_WAIT_MS (backpressure); the MQTT task
+ *          itself cannot wait for its own acks, so there the message is dropped.
+ * @param track Telemetry index whose ID and send time are recorded when the
+ *              message goes out (PUBACK latency), -1 for none
+ * @return Message ID if sent, 0 if queued in the pool, -1 if dropped
+ */
+static int mqtt_pub_tracked(const char *topic, const char *data, int len, int qos, bool retain, int track)
+{
+    if (!client) return -1;
+    if (len <= 0) len = (int)strlen(data);
+    if (qos == 0) return esp_mqtt_client_publish(client, topic, data, len, 0, retain);
+
+    bool direct = false;
+    portENTER_CRITICAL(&pool_lock);
+    if (inflight < MQTT_MAX_INFLIGHT && pool_count == 0) {
+        inflight++;
+        if (inflight > pool_stats.inflight_hw) pool_stats.inflight_hw = inflight;
+        direct = true;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (direct) return mqtt_send_counted(topic, data, len, qos, retain, track);
+
+    TickType_t wait = (xTaskGetCurrentTaskHandle() == mqtt_task) ? 0 : pdMS_TO_TICKS(MQTT_POOL_WAIT_MS);
+    if (strlen(topic) >= MQTT_POOL_TOPIC || len > MQTT_POOL_PAYLOAD) {
+        mqtt_pool_count_drop();
+        ESP_LOGW(TAG, "Publish too large for the pool, dropped %s", topic);
+        return -1;
+    }
+    mqtt_slot_t *s = mqtt_pool_reserve(wait);
+    if (!s) {
+        ESP_LOGW(TAG, "Publish pool full, dropped %s", topic);
+        return -1;
+    }
+
+    strcpy(s->topic, topic);
+    memcpy(s->data, data, (size_t)len);
+    s->track = (int8_t)track;
+    mqtt_pool_commit(s, (size_t)len, qos, retain);
+    return 0;
+}
+
+/**
+ * @brief Publish through the bounded pool (see mqtt_pub_tracked())
+ */
+static int mqtt_pub(const char *topic, const char *data, int len, int qos, bool retain)
+{
+    return mqtt_pub_tracked(topic, data, len, qos, retain, -1);
+}
+
+/**
+ * @brief Publish a QoS1 message straight to esp-mqtt, never through the pool
+ * @details For messages larger than a pool slot. Goes over the in-flight cap
+ *          (the outbox limit has room for it); the caller waits for the pool
+ *          to drain first, so ordering is kept.
+ * @return Message ID, -1 if esp-mqtt refused it (counted as dropped)
+ */
+static int mqtt_pub_direct(const char *topic, const char *data, int len, bool retain)
+{
+    if (!client) return -1;
+    portENTER_CRITICAL(&pool_lock);
+    inflight++;
+    if (inflight > pool_stats.inflight_hw) pool_stats.inflight_hw = inflight;
+    portEXIT_CRITICAL(&pool_lock);
+    return mqtt_send_counted(topic, data, len, 1, retain, -1);
+}
+
+/**
+ * @brief Account for a QoS1 message leaving the outbox (acked or expired)
+ */
+static void mqtt_pool_release(void)
+{
+    portENTER_CRITICAL(&pool_lock);
+    if (inflight) inflight--;
+    portEXIT_CRITICAL(&pool_lock);
+    mqtt_pool_pump();
+}
+
+/**
+ * @brief Fall back from a cached broker address to the configured hostname
+ * @details Called when connecting to the cached IPv4 fails: the cache is dropped
+ *          and the client is pointed back to the hostname, so its own reconnect
+ *          logic performs a fresh DNS lookup.
+ */
+static void mqtt_broker_fallback_to_hostname(void)
+{
+    if (!broker_cache_used_cached()) return;
+
+    broker_cache_invalidate();
+    config_data_t cfg = config_get();
+    esp_mqtt_client_config_t fallback = {
+        .broker.address.hostname = cfg.mqtt_host,
+    };
+    esp_mqtt_set_config(client, &fallback);
+    ESP_LOGW(TAG, "Cached broker address failed, re-resolving %s", cfg.mqtt_host);
+}
+
+/**
+ * @brief Map a log level name ("none".."verbose") to esp_log_level_t
+ * @return Level, or -1 if the name is unknown
+ */
+static int log_level_from_name(const char *name)
+{
+    static const char *const names[] = { "none", "error", "warn", "info", "debug", "verbose" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Format a setting as published on its retained echo topic
+ * @param type CMD_SET_* command that changes the setting
+ * @param c Configuration holding the value
+ * @details Single values as plain text; energy model, battery policy and trend
+ *          as the same CSV accepted by their set topics.
+ * @return Echo topic, NULL if @p type is not a setting
+ */
+static const char *mqtt_format_setting(cmd_type_t type, const config_data_t *c, char *buf, size_t len)
+{
+    switch (type) {
+        case CMD_SET_SLEEP:
+            snprintf(buf, len, "%d", c->sleep_minutes);
+            return topic_sleep;
+        case CMD_SET_VMIN:
+            fixed_format(buf, len, c->batt_mv_min, 3, 2);
+            return topic_batt_vmin_state;
+        case CMD_SET_VMAX:
+            fixed_format(buf, len, c->batt_mv_max, 3, 2);
+            return topic_batt_vmax_state;
+        case CMD_SET_WET:
+            snprintf(buf, len, "%u", c->soil_wet_raw);
+            return topic_soil_wet_state;
+        case CMD_SET_DRY:
+            snprintf(buf, len, "%u", c->soil_dry_raw);
+            return topic_soil_dry_state;
+        case CMD_SET_HIST_PERIOD:
+            snprintf(buf, len, "%u", c->hist_period_h);
+            return topic_hist_period_state;
+        case CMD_SET_ENERGY_MODEL:
+            snprintf(buf, len, "%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%u",
+                     c->e_radio_ua, c->e_cpu_ua, c->e_probe_ua, c->e_sleep_ua, c->batt_capacity_mah);
+            return topic_energy_model_state;
+        case CMD_SET_BATT_POLICY:
+            snprintf(buf, len, "%u,%u,%u,%u",
+                     c->pol_stretch_mv, c->pol_crit_mv, c->pol_max_factor, c->pol_heartbeat_every);
+            return topic_batt_policy_state;
+        case CMD_SET_TREND:
+            snprintf(buf, len, "%u,%u,%u,%u,%u", c->trend_enabled, c->trend_min_minutes,
+                     c->trend_max_minutes, c->trend_deadband_pm, c->trend_threshold_pm);
+            return topic_trend_state;
+        case CMD_SET_WAKE_SLOT:
+            snprintf(buf, len, "%" PRIi32, c->wake_slot_s);
+            return topic_wake_slot_state;
+        case CMD_SET_STUB_SKIP:
+            snprintf(buf, len, "%u", c->stub_skip);
+            return topic_stub_skip_state;
+        case CMD_SET_HEALTH_EVERY:
+            snprintf(buf, len, "%u", c->health_every);
+            return topic_health_every_state;
+        case CMD_SET_DISC_MODE:
+            snprintf(buf, len, "%s", c->disc_mode == DISC_MODE_DEVICE ? "device" : "entity");
+            return topic_disc_mode_state;
+        case CMD_SET_GROUP:
+            snprintf(buf, len, "%s", c->group);
+            return topic_group_state;
+        case CMD_SET_CONN_SLEEP:
+            snprintf(buf, len, "%u,%" PRIu32 ",%u", c->conn_mode, c->e_conn_ua, c->listen_interval);
+            return topic_conn_sleep_state;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * @brief Publish the retained echo of one setting
+ * @param type CMD_SET_* command that changes the setting
+ * @param c Configuration holding the value
+ */
+static void mqtt_publish_setting_state(cmd_type_t type, const config_data_t *c)
+{
+    char buf[48];
+    const char *topic = mqtt_format_setting(type, c, buf, sizeof(buf));
+    if (topic) mqtt_pub(topic, buf, 0, 1, true);
+}
+
+/**
+ * @brief Parse a whole decimal integer within [min, max]
+ * @details Unlike atoi, "1.5" or "12abc" are rejected; blanks around the
+ *          number are allowed.
+ */
+static bool mqtt_parse_int(const char *s, long min, long max, int32_t *out)
+{
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if (end == s || errno) return false;
+    while (*end == ' ' || *end == '\r' || *end == '\n') end++;
+    if (*end || v < min || v > max) return false;
+    *out = (int32_t)v;
+    return true;
+}
+
+/**
+ * @brief Convert and range-check a setting value
+ * @param type CMD_SET_* to parse
+ * @param s Value as text: set topic payload or config/desired value
+ * @param cmd Filled in on success
+ * @details Checks that depend on other settings (Vmin < Vmax) are left to the
+ *          worker, which sees the pending configuration.
+ * @return false if the value is invalid
+ */
+static bool mqtt_parse_setting(cmd_type_t type, const char *s, cmd_t *cmd)
+{
+    int32_t v;
+    unsigned a, b, c, d, e;
+    unsigned long ul[5];
+
+    cmd->type = type;
+    switch (type) {
+        case CMD_SET_SLEEP:
+            return mqtt_parse_int(s, 0, 1440, &cmd->arg.i);
+        /* volts, kept in mV */
+        case CMD_SET_VMIN:
+        case CMD_SET_VMAX:
+            if (!fixed_parse(s, 3, &v)) return false;
+            cmd->arg.i = v;
+            return v >= 2500 && v <= 5500;
+        case CMD_SET_WET:
+        case CMD_SET_DRY:
+            return mqtt_parse_int(s, 0, 4095, &cmd->arg.i);
+        case CMD_SET_HIST_PERIOD:
+            return mqtt_parse_int(s, 0, 24 * 7, &cmd->arg.i);
+        /* "radio_ua,cpu_ua,probe_ua,sleep_ua,capacity_mah" */
+        case CMD_SET_ENERGY_MODEL:
+            if (sscanf(s, "%lu,%lu,%lu,%lu,%lu", &ul[0], &ul[1], &ul[2], &ul[3], &ul[4]) != 5 ||
+                ul[0] > 500000 || ul[1] > 200000 || ul[2] > 100000 || ul[3] > 10000 ||
+                ul[4] == 0 || ul[4] > 60000) {
+                return false;
+            }
+            for (int i = 0; i < 5; i++) cmd->arg.u[i] = ul[i];
+            return true;
+        /* "stretch_mv,crit_mv,max_factor,heartbeat_every" */
+        case CMD_SET_BATT_POLICY:
+            if (sscanf(s, "%u,%u,%u,%u", &a, &b, &c, &d) != 4 ||
+                b >= a || a > 2000 || c < 1 || c > 24 || d > 255) {
+                return false;
+            }
+            cmd->arg.u[0] = a;
+            cmd->arg.u[1] = b;
+            cmd->arg.u[2] = c;
+            cmd->arg.u[3] = d;
+            return true;
+        /* "enabled,min_minutes,max_minutes,deadband_pm,threshold_pm" */
+        case CMD_SET_TREND:
+            if (sscanf(s, "%u,%u,%u,%u,%u", &a, &b, &c, &d, &e) != 5 ||
+                a > 1 || b < 1 || b > c || c > 1440 || d < 1 || d > 1000 || e > 1000) {
+                return false;
+            }
+            cmd->arg.u[0] = a;
+            cmd->arg.u[1] = b;
+            cmd->arg.u[2] = c;
+            cmd->arg.u[3] = d;
+            cmd->arg.u[4] = e;
+            return true;
+        /* -1 = derived from device ID */
+        case CMD_SET_WAKE_SLOT:
+            return mqtt_parse_int(s, -1, 86400, &cmd->arg.i);
+        case CMD_SET_STUB_SKIP:
+            return mqtt_parse_int(s, 0, 255, &cmd->arg.i);
+        case CMD_SET_HEALTH_EVERY:
+            return mqtt_parse_int(s, 0, 10000, &cmd->arg.i);
+        /* "entity" (one config per entity) or "device" (one consolidated config) */
+        case CMD_SET_DISC_MODE:
+            if (strcmp(s, "entity") == 0) cmd->arg.i = DISC_MODE_ENTITY;
+            else if (strcmp(s, "device") == 0) cmd->arg.i = DISC_MODE_DEVICE;
+            else return false;
+            return true;
+        /* group name, used in a topic: [a-z0-9_-], "" = no group */
+        case CMD_SET_GROUP:
+            if (strlen(s) >= sizeof(((config_data_t *)0)->group) ||
+                s[strspn(s, "abcdefghijklmnopqrstuvwxyz0123456789_-")] != '\0') {
+                return false;
+            }
+            strlcpy(cmd->arg.s, s, sizeof(cmd->arg.s));
+            return true;
+        /* "mode,conn_ua,listen_interval": mode 0 off, 1 auto, 2 always */
+        case CMD_SET_CONN_SLEEP:
+            if (sscanf(s, "%u,%lu,%u", &a, &ul[0], &b) != 3 ||
+                a > CONN_MODE_ON || ul[0] < 100 || ul[0] > 100000 || b < 1 || b > 20) {
+                return false;
+            }
+            cmd->arg.u[0] = a;
+            cmd->arg.u[1] = ul[0];
+            cmd->arg.u[2] = b;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Settings changed by the command worker, not yet saved
+ * @details Commands edit this copy; it is written to NVS once when the worker
+ *          queue drains, so a burst of retained set messages costs one commit.
+ *          Only touched from the worker task.
+ */
+static config_data_t work_cfg;
+static uint32_t work_dirty = 0;   /**< one bit per CMD_SET_* changed */
+
+/** @brief Outcome of the last config/desired, sent with the next config/reported */
+static bool report_due = false;
+static uint32_t report_rejected = 0;   /**< one bit per CMD_SET_* rejected */
+static unsigned report_unknown = 0;    /**< keys that are not settings */
+static bool report_malformed = false;
+
+/** @brief Settings being applied come from a fleet document (not a device override) */
+static bool applying_fleet = false;
+
+/** @brief A configuration document is being applied (one save, one report at the end) */
+static bool applying_doc = false;
+
+/**
+ * @brief Settings last taken from a fleet document (all/group), one bit per CMD_SET_*
+ * @details Kept in RTC memory: retained set topics may be delivered before the
+ *          documents on the next wake, and must not override them (see
+ *          setting_owner_accept()).
+ */
+static RTC_DATA_ATTR uint32_t fleet_mask = 0;
+
+/** @brief Where the setting being applied comes from */
+static setting_origin_t mqtt_cmd_origin(const cmd_t *cmd)
+{
+    if (applying_fleet) return SETTING_FROM_FLEET_DOC;
+    if (applying_doc) return SETTING_FROM_DEVICE_DOC;
+    return cmd->retained ? SETTING_FROM_RETAINED : SETTING_FROM_COMMAND;
+}
+
+/** @brief Discovery mode changed by a document: migrated after its save and report */
+static bool disc_switch_pending = false;
+static uint8_t disc_switch_from;
+
+/** @brief Real configuration changes made by the worker, to tell no-op commands apart */
+static uint32_t change_count = 0;
+static bool last_cmd_changed = false;
+
+/** @brief Pending settings, reloaded from the saved config when nothing is pending */
+static config_data_t *work_config(void)
+{
+    if (!work_dirty) work_cfg = config_get();
+    return &work_cfg;
+}
+
+/**
+ * @brief Publish all settings as one retained config/reported document
+ * @details Same keys and value text as config/desired (numbers bare, CSV and
+ *          names quoted), plus the outcome of the last desired document:
+ *          "rejected" settings, "unknown" keys and "malformed". Streamed into
+ *          a pool slot; the settings alone take about 320 B.
+ */
+static void mqtt_publish_config_reported(void)
+{
+    mqtt_slot_t *s = mqtt_pool_reserve(pdMS_TO_TICKS(MQTT_POOL_WAIT_MS));
+    if (!s) {
+        ESP_LOGW(TAG, "Publish pool full, dropped %s", topic_config_reported);
+        return;
+    }
+    strlcpy(s->topic, topic_config_reported, sizeof(s->topic));
+
+    const config_data_t *c = work_config();
+    const size_t cap = sizeof(s->data);
+    size_t n = 0;
+    char val[48];
+    for (int t = 0; t < CMD_SETTINGS_END; t++) {
+        mqtt_format_setting((cmd_type_t)t, c, val, sizeof(val));
+        bool bare = t != CMD_SET_GROUP && val[0] && !val[strspn(val, "-.0123456789")];
+        const char *q = bare ? "" : "\"";
+        n += snprintf(s->data + n, cap - n, "%c\"%s\":%s%s%s", t ? ',' : '{',
+                      cmd_name((cmd_type_t)t), q, val, q);
+        if (n >= cap) n = cap - 1;
+    }
+    if (report_rejected) {
+        bool first = true;
+        for (int t = 0; t < CMD_SETTINGS_END; t++) {
+            const char *name = cmd_name((cmd_type_t)t);
+            /* keep room for the closing brackets and the other fields */
+            if (!(report_rejected & (1u << t)) || n + strlen(name) + 48 > cap) continue;
+            n += snprintf(s->data + n, cap - n, "%s\"%s\"", first ? ",\"rejected\":[" : ",", name);
+            first = false;
+        }
+        if (!first) n += snprintf(s->data + n, cap - n, "]");
+    }
+    if (report_unknown) n += snprintf(s->data + n, cap - n, ",\"unknown\":%u", report_unknown);
+    if (report_malformed) n += snprintf(s->data + n, cap - n, ",\"malformed\":true");
+    n += snprintf(s->data + n, cap - n, "}");
+    if (n >= cap) n = cap - 1;
+
+    mqtt_pool_commit(s, n, 1, true);
+}
+
+/**
+ * @brief Worker idle hook: save pending settings, echo the changed ones and
+ *        answer on config/reported
+ */
+static bool mqtt_discovery_switch(uint8_t mode);
+
+static void mqtt_cmd_idle(void)
+{
+    if (work_dirty) {
+        config_save(&work_cfg);
+        ESP_LOGI(TAG, "Saved settings (changed mask 0x%" PRIx32 ")", work_dirty);
+        for (int t = 0; t < CMD_SETTINGS_END; t++) {
+            if (work_dirty & (1u << t)) mqtt_publish_setting_state((cmd_type_t)t, &work_cfg);
+        }
+        work_dirty = 0;
+        report_due = true;
+    }
+    if (report_due) {
+        mqtt_publish_config_reported();
+        report_due = false;
+        report_rejected = 0;
+        report_unknown = 0;
+        report_malformed = false;
+    }
+    if (disc_switch_pending) {
+        disc_switch_pending = false;
+        config_data_t *c = work_config();
+        if (c->disc_mode != disc_switch_from && !mqtt_discovery_switch(c->disc_mode)) {
+            /* broker did not take the new configs: back to the old mode, reported as rejected */
+            c->disc_mode = disc_switch_from;
+            work_dirty |= 1u << CMD_SET_DISC_MODE;
+            report_rejected |= 1u << CMD_SET_DISC_MODE;
+            mqtt_cmd_idle();
+        }
+    }
+}
+
+/**
+ * @brief Calibrate the wet or dry point from the current probe reading
+ * @details Saves right away, then takes a new reading with the new calibration
+ *          and republishes it.
+ */
+static bool mqtt_cmd_mark(bool wet)
+{
+    int raw = sensor_read_soil_raw_avg();
+    if (raw < 0 || raw > 4095) return false;
+
+    config_data_t *c = work_config();
+    uint16_t *point = wet ? &c->soil_wet_raw : &c->soil_dry_raw;
+    uint32_t bit = 1u << (wet ? CMD_SET_WET : CMD_SET_DRY);
+    if (*point != (uint16_t)raw) {
+        *point = (uint16_t)raw;
+        c->local_mask |= bit;
+        work_dirty |= bit;
+        change_count++;
+    }
+    mqtt_cmd_idle();
+
+    mqtt_publish_sensor_data(read_soil_moisture_pm(), read_battery_mv());
+    return true;
+}
+
+/**
+ * @brief Change the discovery mode and move the retained configs
+ * @details Saves first, so a reset halfway through republishes in the new
+ *          mode on the next session. If the broker does not take the new
+ *          configs, the old mode is saved back and the command is rejected.
+ *          Inside a configuration document only the setting changes here;
+ *          the migration runs from mqtt_cmd_idle() after the document's
+ *          single save and config/reported.
+ */
+static bool mqtt_cmd_discovery_mode(uint8_t mode, bool pin)
+{
+    config_data_t *c = work_config();
+    if (c->disc_mode == mode) return true;
+    if (pin) c->local_mask |= 1u << CMD_SET_DISC_MODE;
+    uint8_t old = c->disc_mode;
+    change_count++;
+    c->disc_mode = mode;
+    work_dirty |= 1u << CMD_SET_DISC_MODE;
+    if (applying_doc) {
+        if (!disc_switch_pending) disc_switch_from = old;
+        disc_switch_pending = true;
+        return true;
+    }
+    mqtt_cmd_idle();
+
+    if (mqtt_discovery_switch(mode)) return true;
+    c = work_config();
+    c->disc_mode = old;
+    work_dirty |= 1u << CMD_SET_DISC_MODE;
+    mqtt_cmd_idle();
+    return false;
+}
+
+static bool mqtt_cmd_run(const cmd_t *cmd);
+
+/**
+ * @brief Setting whose cmd_name() is @p key
+ * @return CMD_SET_* type, -1 if @p key is not a setting
+ */
+static int mqtt_setting_from_name(const char *key)
+{
+    for (int t = 0; t < CMD_SETTINGS_END; t++) {
+        if (strcmp(key, cmd_name((cmd_type_t)t)) == 0) return t;
+    }
+    return -1;
+}
+
+/**
+ * @brief Apply one configuration document to the pending configuration
+ * @param scope Document to apply
+ * @param taken Settings already set by a document of higher precedence;
+ *        the settings applied here are added
+ * @details Keys are the setting names (cmd_name()), values the same text as
+ *          their set topics; numbers may be bare. Values equal to the current
+ *          ones change nothing. Settings rejected because of the order of the
+ *          keys (e.g. raising both battery bounds) are retried once.
+ *          Fleet documents skip the group key and every setting fixed on the
+ *          device (local_mask); in the device document null releases a
+ *          setting back to the fleet.
+ */
+static void mqtt_apply_doc(doc_scope_t scope, uint32_t *taken)
+{
+    static const char *const scope_name[DOC_COUNT] = { "all", "group", "device" };
+    static char doc[CONFIG_DOC_MAX];   /* worker task only */
+    portENTER_CRITICAL(&desired_lock);
+    memcpy(doc, desired_doc[scope], sizeof(doc));
+    portEXIT_CRITICAL(&desired_lock);
+    if (!doc[0]) return;
+
+    applying_fleet = scope != DOC_DEVICE;
+    cmd_t retry[CMD_SETTINGS_END];
+    uint32_t retry_mask = 0;
+    char key[24], val[48];
+    json_flat_t it;
+    json_flat_init(&it, doc);
+    while (json_flat_next(&it, key, sizeof(key), val, sizeof(val))) {
+        int t = mqtt_setting_from_name(key);
+        cmd_t cmd = { 0 };
+        if (t < 0) {
+            ESP_LOGW(TAG, "config/desired (%s): unknown key '%s'", scope_name[scope], key);
+            report_unknown++;
+            continue;
+        }
+        uint32_t bit = 1u << t;
+        config_data_t *c = work_config();
+        if (scope == DOC_DEVICE && !it.string && strcmp(val, "null") == 0) {
+            if (c->local_mask & bit) {
+                c->local_mask &= ~bit;
+                work_dirty |= bit;
+                change_count++;
+            }
+            continue;
+        }
+        if (applying_fleet && (t == CMD_SET_GROUP || (*taken & bit))) continue;
+        if (!setting_owner_accept(applying_fleet ? SETTING_FROM_FLEET_DOC : SETTING_FROM_DEVICE_DOC, bit, c->local_mask, fleet_mask)) continue;
+        *taken |= bit;
+
+        if (!mqtt_parse_setting((cmd_type_t)t, val, &cmd)) {
+            ESP_LOGW(TAG, "config/desired (%s): invalid %s '%s'", scope_name[scope], key, val);
+            report_rejected |= bit;
+        } else if (!mqtt_cmd_run(&cmd)) {
+            retry[t] = cmd;
+            retry_mask |= bit;
+        }
+    }
+    for (int t = 0; t < CMD_SETTINGS_END; t++) {
+        if ((retry_mask & (1u << t)) && !mqtt_cmd_run(&retry[t])) report_rejected |= 1u << t;
+    }
+    if (it.error) {
+        ESP_LOGW(TAG, "config/desired (%s): malformed document", scope_name[scope]);
+        report_malformed = true;
+    }
+    applying_fleet = false;
+}
+
+/**
+ * @brief Apply the configuration documents: device, then group, then all
+ * @details Precedence all < group < device: a setting is taken from the most
+ *          specific document that has it, and settings changed on the device
+ *          itself (set topics, device document) stay out of fleet documents.
+ *          All documents are re-applied on every arrival; only real changes
+ *          are saved, in one commit, and answered with a single
+ *          config/reported when the queue drains (a discovery_mode change
+ *          is migrated after that). A document already in sync costs no
+ *          flash write, no config/reported and no cmd/result. The settings
+ *          taken from fleet documents are remembered in fleet_mask.
+ */
+static bool mqtt_cmd_desired(void)
+{
+    uint32_t taken = 0;
+    applying_doc = true;
+    mqtt_apply_doc(DOC_DEVICE, &taken);
+    uint32_t device = taken;
+    mqtt_apply_doc(DOC_GROUP, &taken);
+    mqtt_apply_doc(DOC_ALL, &taken);
+    applying_doc = false;
+    fleet_mask = taken & ~device;
+
+    bool ok = !report_rejected && !report_unknown && !report_malformed;
+    if (!ok) report_due = true;
+    return ok;
+}
+
+/**
+ * @brief Follow a group change: subscribe to the new group document
+ * @details The old group document is forgotten; settings it applied stay
+ *          until another document changes them.
+ */
+static void mqtt_group_changed(const char *old_group, const char *group)
+{
+    if (old_group[0]) esp_mqtt_client_unsubscribe(client, topic_group_desired);
+
+    portENTER_CRITICAL(&desired_lock);
+    desired_doc[DOC_GROUP][0] = '\0';
+    if (group[0]) {
+        snprintf(topic_group_desired, sizeof(topic_group_desired), "soil_sensor/group/%s/config/desired", group);
+    } else {
+        topic_group_desired[0] = '\0';
+    }
+    portEXIT_CRITICAL(&desired_lock);
+
+    if (group[0]) esp_mqtt_client_subscribe(client, topic_group_desired, 1);
+    ESP_LOGI(TAG, "Group '%s' -> '%s'", old_group, group);
+}
+
+/**
+ * @brief Execute one command in the worker task
+ * @details Value ranges were checked by the MQTT handler; checks that depend on
+ *          other settings are done here against the pending configuration.
+ * @return false if the command was rejected
+ */
+static bool mqtt_cmd_run(const cmd_t *cmd)
+{
+    switch (cmd->type) {
+        case CMD_MARK_WET:  return mqtt_cmd_mark(true);
+        case CMD_MARK_DRY:  return mqtt_cmd_mark(false);
+        case CMD_LOG_FLUSH: mqtt_publish_log(true); return true;
+        case CMD_CONFIG_DESIRED: return mqtt_cmd_desired();
+        default: break;
+    }
+
+    config_data_t *c = work_config();
+    setting_origin_t from = mqtt_cmd_origin(cmd);
+    if (!setting_owner_accept(from, 1u << cmd->type, c->local_mask, fleet_mask)) {
+        ESP_LOGI(TAG, "Retained %s ignored: set by a fleet document", cmd_name(cmd->type));
+        return true;
+    }
+    if (cmd->type == CMD_SET_DISC_MODE) {
+        return mqtt_cmd_discovery_mode((uint8_t)cmd->arg.i, setting_owner_pins(from));
+    }
+    config_data_t prev;
+    memcpy(&prev, c, sizeof(prev));
+    switch (cmd->type) {
+        case CMD_SET_SLEEP:
+            c->sleep_minutes = cmd->arg.i;
+            break;
+        case CMD_SET_VMIN:
+            if (cmd->arg.i >= c->batt_mv_max) return false;
+            c->batt_mv_min = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_VMAX:
+            if (cmd->arg.i <= c->batt_mv_min) return false;
+            c->batt_mv_max = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_WET:
+            c->soil_wet_raw = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_DRY:
+            c->soil_dry_raw = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_HIST_PERIOD:
+            c->hist_period_h = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_ENERGY_MODEL:
+            c->e_radio_ua = cmd->arg.u[0];
+            c->e_cpu_ua = cmd->arg.u[1];
+            c->e_probe_ua = cmd->arg.u[2];
+            c->e_sleep_ua = cmd->arg.u[3];
+            c->batt_capacity_mah = (uint16_t)cmd->arg.u[4];
+            break;
+        case CMD_SET_BATT_POLICY:
+            c->pol_stretch_mv = (uint16_t)cmd->arg.u[0];
+            c->pol_crit_mv = (uint16_t)cmd->arg.u[1];
+            c->pol_max_factor = (uint8_t)cmd->arg.u[2];
+            c->pol_heartbeat_every = (uint8_t)cmd->arg.u[3];
+            break;
+        case CMD_SET_TREND:
+            c->trend_enabled = (uint8_t)cmd->arg.u[0];
+            c->trend_min_minutes = (uint16_t)cmd->arg.u[1];
+            c->trend_max_minutes = (uint16_t)cmd->arg.u[2];
+            c->trend_deadband_pm = (uint16_t)cmd->arg.u[3];
+            c->trend_threshold_pm = (uint16_t)cmd->arg.u[4];
+            break;
+        case CMD_SET_WAKE_SLOT:
+            if (c->wake_slot_s != cmd->arg.i) sleep_schedule_reset();
+            c->wake_slot_s = cmd->arg.i;
+            break;
+        case CMD_SET_STUB_SKIP:
+            c->stub_skip = (uint8_t)cmd->arg.i;
+            break;
+        case CMD_SET_HEALTH_EVERY:
+            c->health_every = (uint16_t)cmd->arg.i;
+            break;
+        case CMD_SET_GROUP:
+            strlcpy(c->group, cmd->arg.s, sizeof(c->group));
+            if (strcmp(prev.group, c->group) != 0) mqtt_group_changed(prev.group, c->group);
+            break;
+        /* listen_interval applies from the next association */
+        case CMD_SET_CONN_SLEEP:
+            c->conn_mode = (uint8_t)cmd->arg.u[0];
+            c->e_conn_ua = cmd->arg.u[1];
+            c->listen_interval = (uint8_t)cmd->arg.u[2];
+            break;
+        default:
+            return false;
+    }
+    /* values already in place (e.g. retained set topics) cost no flash write */
+    if (memcmp(&prev, c, sizeof(prev)) != 0) {
+        /* changed on the device itself: fleet documents no longer override it.
+         * Retained set topics (e.g. HA entities) may be older than the fleet
+         * documents and do not pin it. */
+        if (setting_owner_pins(from)) c->local_mask |= 1u << cmd->type;
+        work_dirty |= 1u << cmd->type;
+        change_count++;
+    }
+    return true;
+}
+
+/**
+ * @brief Worker entry point: run a command and note whether it changed anything
+ */
+static bool mqtt_cmd_exec(const cmd_t *cmd)
+{
+    uint32_t before = change_count;
+    bool ok = mqtt_cmd_run(cmd);
+    last_cmd_changed = change_count != before;
+    return ok;
+}
+
+/**
+ * @brief Report a finished command on soil_sensor/<id>/cmd/result
+ * @details JSON {"cmd","ok","ms","merged"}: merged counts identical requests
+ *          absorbed while the command was queued. Settings are saved when the
+ *          queue drains, right after the last report. Retained messages
+ *          delivered again at connect time and configuration documents that
+ *          change nothing get no result: no extra QoS1 round trip on every wake.
+ */
+static void mqtt_cmd_done(const cmd_t *cmd, bool ok, uint32_t ms, unsigned merged)
+{
+    if ((cmd->retained || cmd->type == CMD_CONFIG_DESIRED) && ok && !last_cmd_changed) return;
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "{\"cmd\":\"%s\",\"ok\":%s,\"ms\":%" PRIu32 ",\"merged\":%u}",
+             cmd_name(cmd->type), ok ? "true" : "false", ms, merged);
+    mqtt_pub(topic_cmd_result, msg, 0, 1, false);
+}
+
+/** @brief Command worker callbacks */
+static const cmd_worker_ops_t cmd_ops = {
+    .run = mqtt_cmd_exec,
+    .done = mqtt_cmd_done,
+    .idle = mqtt_cmd_idle,
+};
+
+/**
+ * @brief Scope of a configuration document topic
+ * @return doc_scope_t, -1 if the topic is not a config/desired topic
+ */
+static int mqtt_doc_scope(const char *topic, int len)
+{
+    int scope = -1;
+    portENTER_CRITICAL(&desired_lock);
+    if (strncmp(topic, topic_config_desired, len) == 0) scope = DOC_DEVICE;
+    else if (topic_group_desired[0] && strncmp(topic, topic_group_desired, len) == 0) scope = DOC_GROUP;
+    else if (strncmp(topic, topic_all_desired, len) == 0) scope = DOC_ALL;
+    portEXIT_CRITICAL(&desired_lock);
+    return scope;
 }
 
 /**
@@ -82,175 +1166,132 @@ uint8_t batt_percent_from_v(float v)
 static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base_ev, int32_t event_id, void *event_data)
 {
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t) event_data;
+    mqtt_task = xTaskGetCurrentTaskHandle();
 
     switch (event_id) {
         case MQTT_EVENT_CONNECTED:
         {
             ESP_LOGI(TAG, "MQTT connected");
-            mqtt_publish_discovery();
-
+            wake_trace_mark(WT_MQTT_CONNECTED);
+            mqtt_ever_connected = true;
+            latency_hist_record_wake();
             /* subscribe to control topics */
-            esp_mqtt_client_subscribe(client, topic_set, 1);
-            esp_mqtt_client_subscribe(client, topic_set_vmin, 1);
-            esp_mqtt_client_subscribe(client, topic_set_vmax, 1);
-            esp_mqtt_client_subscribe(client, topic_set_wet,  1);
-            esp_mqtt_client_subscribe(client, topic_set_dry,  1);
+            for (int t = 0; t < CMD_SETTINGS_END; t++) {
+                esp_mqtt_client_subscribe(client, setting_topic[t], 1);
+            }
+            esp_mqtt_client_subscribe(client, topic_config_desired, 1);
+            esp_mqtt_client_subscribe(client, topic_all_desired, 1);
+            if (topic_group_desired[0]) esp_mqtt_client_subscribe(client, topic_group_desired, 1);
             esp_mqtt_client_subscribe(client, topic_cmd_mark_wet, 1);
             esp_mqtt_client_subscribe(client, topic_cmd_mark_dry, 1);
+            esp_mqtt_client_subscribe(client, topic_cmd_log_flush, 1);
+            esp_mqtt_client_subscribe(client, topic_set_log_level, 1);
 
             ESP_LOGI(TAG, "Subscribed to control topics.");
 
-            /* publish current sleep interval (retain) */
-            char msg[16];
-            snprintf(msg, sizeof(msg), "%d", config_get().sleep_minutes);
-            esp_mqtt_client_publish(client, topic_sleep, msg, 0, 1, true);
+            /* replaces the last will ("offline") or the "sleeping" of the previous wake */
+            mqtt_pub(topic_availability, AVAIL_ONLINE, 0, 1, true);
 
-            /* publish current calibration values (retain) */
-            {
-                config_data_t c = config_get();
-                char buf[16];
-
-                snprintf(buf, sizeof(buf), "%.2f", c.batt_v_min);
-                esp_mqtt_client_publish(client, topic_batt_vmin_state, buf, 0, 1, true);
-
-                snprintf(buf, sizeof(buf), "%.2f", c.batt_v_max);
-                esp_mqtt_client_publish(client, topic_batt_vmax_state, buf, 0, 1, true);
-
-                snprintf(buf, sizeof(buf), "%u", c.soil_wet_raw);
-                esp_mqtt_client_publish(client, topic_soil_wet_state, buf, 0, 1, true);
-
-                snprintf(buf, sizeof(buf), "%u", c.soil_dry_raw);
-                esp_mqtt_client_publish(client, topic_soil_dry_state, buf, 0, 1, true);
-            }
+            xEventGroupSetBits(session_bits, SESSION_CONNECTED_BIT);
             break;
         }
+        case MQTT_EVENT_PUBLISHED:
+            wake_trace_mark(WT_LAST_PUBACK);
+            for (int i = 0; i < TELEMETRY_MSGS; i++) {
+                if (telemetry_msg_id[i] > 0 && telemetry_msg_id[i] == event->msg_id) {
+                    latency_hist_record(LAT_PUBACK, (uint32_t)((esp_timer_get_time() - telemetry_sent_us[i]) / 1000));
+                    telemetry_msg_id[i] = -1;
+                }
+            }
+            mqtt_pool_release();
+            break;
+
+        case MQTT_EVENT_DELETED:
+            /* QoS1 message expired from the outbox without PUBACK */
+            ESP_LOGW(TAG, "Outbox message %d expired", event->msg_id);
+            mqtt_pool_count_drop();
+            mqtt_pool_release();
+            break;
+
         case MQTT_EVENT_DISCONNECTED:
+            xEventGroupClearBits(session_bits, SESSION_CONNECTED_BIT);
+            if (mqtt_closing) break;
             ESP_LOGW(TAG, "MQTT disconnected");
+            health_note_retry(HEALTH_RETRY_MQTT);
+            if (!mqtt_ever_connected) mqtt_broker_fallback_to_hostname();
             break;
 
         case MQTT_EVENT_ERROR:
             ESP_LOGE(TAG, "MQTT error");
+            if (!mqtt_ever_connected && event->error_handle &&
+                event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
+                mqtt_broker_fallback_to_hostname();
+            }
             break;
 
         case MQTT_EVENT_DATA:
         {
+            /* later chunks of a long message carry no topic */
+            if (event->current_data_offset > 0) break;
             ESP_LOGI(TAG, "Incoming on topic: %.*s", event->topic_len, event->topic);
 
-            /* sleep_interval/set */
-            if (strncmp(event->topic, topic_set, event->topic_len) == 0)
-            {
-                char val_str[16] = {0};
-                memcpy(val_str, event->data, MIN(event->data_len, (int)sizeof(val_str) - 1));
-                int new_minutes = atoi(val_str);
-
-                if (new_minutes >= 0 && new_minutes <= 1440) {
-                    config_data_t cfg = config_get();
-                    cfg.sleep_minutes = new_minutes;
-                    config_save(&cfg);
-                    ESP_LOGI(TAG, "Updated sleep interval to %d min", new_minutes);
-                    /* echo retained */
-                    char state_topic[64], msg[16];
-                    snprintf(state_topic, sizeof(state_topic), "soil_sensor/%s/sleep_interval", device_id);
-                    snprintf(msg, sizeof(msg), "%d", new_minutes);
-                    esp_mqtt_client_publish(client, state_topic, msg, 0, 1, true);
-                }
+            cmd_t cmd = { .type = CMD_COUNT };
+            bool handled = false;   /* executed here, nothing to queue */
+            char s[64] = {0};
+            memcpy(s, event->data, MIN(event->data_len, (int)sizeof(s) - 1));
+
+            /* settings: converted and range-checked here, applied by the worker */
+            int setting = -1, doc;
+            for (int t = 0; t < CMD_SETTINGS_END && setting < 0; t++) {
+                if (strncmp(event->topic, setting_topic[t], event->topic_len) == 0) setting = t;
             }
-            /* batt_v_min */
-            else if (strncmp(event->topic, topic_set_vmin, event->topic_len) == 0) {
-                char s[16] = {0};
-                memcpy(s, event->data, MIN(event->data_len, (int)sizeof(s)-1));
-                float v = strtof(s, NULL);
-                config_data_t c = config_get();
-                if (v >= 2.50f && v < c.batt_v_max) {
-                    c.batt_v_min = v;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%.2f", v);
-                    esp_mqtt_client_publish(client, topic_batt_vmin_state, msg, 0, 1, true);
-                    ESP_LOGI(TAG, "Updated batt_v_min -> %.2f V", v);
-                } else {
-                    ESP_LOGW(TAG, "Invalid batt_v_min %.2f", v);
-                }
+            if (setting >= 0) {
+                if (!mqtt_parse_setting((cmd_type_t)setting, s, &cmd)) cmd.type = CMD_COUNT;
             }
-            /* batt_v_max */
-            else if (strncmp(event->topic, topic_set_vmax, event->topic_len) == 0) {
-                char s[16] = {0};
-                memcpy(s, event->data, MIN(event->data_len, (int)sizeof(s)-1));
-                float v = strtof(s, NULL);
-                config_data_t c = config_get();
-                if (v <= 5.50f && v > c.batt_v_min) {
-                    c.batt_v_max = v;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%.2f", v);
-                    esp_mqtt_client_publish(client, topic_batt_vmax_state, msg, 0, 1, true);
-                    ESP_LOGI(TAG, "Updated batt_v_max -> %.2f V", v);
-                } else {
-                    ESP_LOGW(TAG, "Invalid batt_v_max %.2f", v);
+            /* config/desired of the device, its group or the fleet: diffed and applied by the worker */
+            else if ((doc = mqtt_doc_scope(event->topic, event->topic_len)) >= 0) {
+                handled = event->data_len == 0;   /* retained document cleared */
+                if (event->data_len < CONFIG_DOC_MAX && event->data_len == event->total_data_len) {
+                    portENTER_CRITICAL(&desired_lock);
+                    memcpy(desired_doc[doc], event->data, event->data_len);
+                    desired_doc[doc][event->data_len] = '\0';
+                    portEXIT_CRITICAL(&desired_lock);
+                    cmd.type = CMD_CONFIG_DESIRED;
                 }
             }
-            /* soil_wet_raw */
-            else if (strncmp(event->topic, topic_set_wet, event->topic_len) == 0) {
-                char s[16] = {0};
-                memcpy(s, event->data, MIN(event->data_len, (int)sizeof(s)-1));
-                int r = atoi(s);
-                if (r >= 0 && r <= 4095) {
-                    config_data_t c = config_get();
-                    c.soil_wet_raw = (uint16_t)r;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%u", c.soil_wet_raw);
-                    esp_mqtt_client_publish(client, topic_soil_wet_state, msg, 0, 1, true);
-                    ESP_LOGI(TAG, "Updated soil_wet_raw -> %u", c.soil_wet_raw);
-                } else {
-                    ESP_LOGW(TAG, "Invalid soil_wet_raw %d", r);
-                }
+            /* log ring: flush on demand */
+            else if (strncmp(event->topic, topic_cmd_log_flush, event->topic_len) == 0) {
+                cmd.type = CMD_LOG_FLUSH;
             }
-            /* soil_dry_raw */
-            else if (strncmp(event->topic, topic_set_dry, event->topic_len) == 0) {
-                char s[16] = {0};
-                memcpy(s, event->data, MIN(event->data_len, (int)sizeof(s)-1));
-                int r = atoi(s);
-                if (r >= 0 && r <= 4095) {
-                    config_data_t c = config_get();
-                    c.soil_dry_raw = (uint16_t)r;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%u", c.soil_dry_raw);
-                    esp_mqtt_client_publish(client, topic_soil_dry_state, msg, 0, 1, true);
-                    ESP_LOGI(TAG, "Updated soil_dry_raw -> %u", c.soil_dry_raw);
+            /* log level per tag: "TAG=level", "*" for all tags (RTC only, cheap) */
+            else if (strncmp(event->topic, topic_set_log_level, event->topic_len) == 0) {
+                handled = true;
+                char *eq = strchr(s, '=');
+                int level = eq ? log_level_from_name(eq + 1) : -1;
+                if (eq) *eq = '\0';
+                if (level >= 0 && log_ring_set_level(s, (esp_log_level_t)level)) {
+                    ESP_LOGI(TAG, "Updated log level %s -> %s", s, eq + 1);
                 } else {
-                    ESP_LOGW(TAG, "Invalid soil_dry_raw %d", r);
+                    ESP_LOGW(TAG, "Invalid log level setting '%s'", s);
                 }
             }
-            /* commands for mark wet/dry */
-            else if (strncmp(event->topic, topic_cmd_mark_wet, event->topic_len) == 0) 
-            {
-                int raw = sensor_read_soil_raw_avg();
-                if (raw >= 0 && raw <= 4095) 
-                {
-                    config_data_t c = config_get();
-                    c.soil_wet_raw = (uint16_t)raw;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%u", c.soil_wet_raw);
-                    esp_mqtt_client_publish(client, topic_soil_wet_state, msg, 0, 1, true);
-                    // rileggi umidità già con nuova calibrazione e ripubblica
-                    float h = read_soil_moisture(); 
-                    mqtt_publish_sensor_data(h, read_battery_voltage());
-                }
+            /* commands for mark wet/dry (several seconds of ADC sampling) */
+            else if (strncmp(event->topic, topic_cmd_mark_wet, event->topic_len) == 0) {
+                cmd.type = CMD_MARK_WET;
             }
-            else if (strncmp(event->topic, topic_cmd_mark_dry, event->topic_len) == 0) 
-            {
-                int raw = sensor_read_soil_raw_avg();
-                if (raw >= 0 && raw <= 4095) {
-                    config_data_t c = config_get();
-                    c.soil_dry_raw = (uint16_t)raw;
-                    config_save(&c);
-                    char msg[16]; snprintf(msg, sizeof(msg), "%u", c.soil_dry_raw);
-                    esp_mqtt_client_publish(client, topic_soil_dry_state, msg, 0, 1, true);
-                    // rileggi umidità già con nuova calibrazione e ripubblica
-                    float h = read_soil_moisture(); 
-                    mqtt_publish_sensor_data(h, read_battery_voltage());
-                }
+            else if (strncmp(event->topic, topic_cmd_mark_dry, event->topic_len) == 0) {
+                cmd.type = CMD_MARK_DRY;
+            }
+            else {
+                handled = true;
             }
 
-
+            if (cmd.type != CMD_COUNT) {
+                cmd.retained = event->retain;
+                cmd_post(&cmd);
+            } else if (!handled) {
+                ESP_LOGW(TAG, "Invalid payload '%s' on %.*s", s, event->topic_len, event->topic);
+            }
             break;
         }
 
@@ -282,6 +1323,7 @@ void start_mqtt(void)
         snprintf(topic_humidity, sizeof(topic_humidity), "%s/humidity", base);
         snprintf(topic_battery,  sizeof(topic_battery),  "%s/battery",  base);
         snprintf(topic_battery_pct, sizeof(topic_battery_pct), "%s/battery_pct", base);
+        snprintf(topic_reading, sizeof(topic_reading), "%s/reading", base);
 
         /* sleep control topics */
         snprintf(topic_sleep, sizeof(topic_sleep), "%s/sleep_interval", base);
@@ -302,11 +1344,81 @@ void start_mqtt(void)
         /* optional command topics (not handled in this file) */
         snprintf(topic_cmd_mark_wet, sizeof(topic_cmd_mark_wet), "%s/cmd/soil_mark_wet", base);
         snprintf(topic_cmd_mark_dry, sizeof(topic_cmd_mark_dry), "%s/cmd/soil_mark_dry", base);
+
+        /* diagnostics topics */
+        snprintf(topic_diag_timeline, sizeof(topic_diag_timeline), "%s/diag/timeline", base);
+        snprintf(topic_awake_ms, sizeof(topic_awake_ms), "%s/awake_ms", base);
+        snprintf(topic_diag_latency, sizeof(topic_diag_latency), "%s/diag/latency", base);
+        snprintf(topic_set_hist_period, sizeof(topic_set_hist_period), "%s/set/hist_period_h", base);
+        snprintf(topic_hist_period_state, sizeof(topic_hist_period_state), "%s/hist_period_h", base);
+
+        /* energy model topics */
+        snprintf(topic_energy_mah_day, sizeof(topic_energy_mah_day), "%s/energy_mah_day", base);
+        snprintf(topic_batt_days_left, sizeof(topic_batt_days_left), "%s/batt_days_left", base);
+        snprintf(topic_set_energy_model, sizeof(topic_set_energy_model), "%s/set/energy_model", base);
+        snprintf(topic_energy_model_state, sizeof(topic_energy_model_state), "%s/energy_model", base);
+
+        /* battery policy topics */
+        snprintf(topic_policy_tier, sizeof(topic_policy_tier), "%s/policy_tier", base);
+        snprintf(topic_set_batt_policy, sizeof(topic_set_batt_policy), "%s/set/batt_policy", base);
+        snprintf(topic_batt_policy_state, sizeof(topic_batt_policy_state), "%s/batt_policy", base);
+
+        /* predictive wake topics */
+        snprintf(topic_set_trend, sizeof(topic_set_trend), "%s/set/trend", base);
+        snprintf(topic_trend_state, sizeof(topic_trend_state), "%s/trend", base);
+
+        /* fleet wake slot topics */
+        snprintf(topic_set_wake_slot, sizeof(topic_set_wake_slot), "%s/set/wake_slot", base);
+        snprintf(topic_wake_slot_state, sizeof(topic_wake_slot_state), "%s/wake_slot", base);
+
+        /* wake stub topics */
+        snprintf(topic_set_stub_skip, sizeof(topic_set_stub_skip), "%s/set/stub_skip", base);
+        snprintf(topic_stub_skip_state, sizeof(topic_stub_skip_state), "%s/stub_skip", base);
+
+        /* health diagnostics topics */
+        snprintf(topic_diag_health, sizeof(topic_diag_health), "%s/diag", base);
+        snprintf(topic_set_health_every, sizeof(topic_set_health_every), "%s/set/health_every", base);
+        snprintf(topic_health_every_state, sizeof(topic_health_every_state), "%s/health_every", base);
+
+        /* configuration documents */
+        snprintf(topic_config_desired, sizeof(topic_config_desired), "%s/config/desired", base);
+        snprintf(topic_config_reported, sizeof(topic_config_reported), "%s/config/reported", base);
+
+        /* fleet configuration: group membership, fleet and group documents */
+        snprintf(topic_set_group, sizeof(topic_set_group), "%s/set/group", base);
+        snprintf(topic_group_state, sizeof(topic_group_state), "%s/group", base);
+        snprintf(topic_set_conn_sleep, sizeof(topic_set_conn_sleep), "%s/set/conn_sleep", base);
+        snprintf(topic_conn_sleep_state, sizeof(topic_conn_sleep_state), "%s/conn_sleep", base);
+        snprintf(topic_all_desired, sizeof(topic_all_desired), "soil_sensor/all/config/desired");
+        config_data_t c = config_get();
+        if (c.group[0]) {
+            snprintf(topic_group_desired, sizeof(topic_group_desired), "soil_sensor/group/%s/config/desired", c.group);
+        }
+
+        /* availability (also the last will topic) */
+        snprintf(topic_availability, sizeof(topic_availability), "%s/availability", base);
+
+        /* discovery mode topics */
+        snprintf(topic_set_disc_mode, sizeof(topic_set_disc_mode), "%s/set/discovery_mode", base);
+        snprintf(topic_disc_mode_state, sizeof(topic_disc_mode_state), "%s/discovery_mode", base);
+
+        /* log ring topics */
+        snprintf(topic_diag_log, sizeof(topic_diag_log), "%s/diag/log", base);
+        snprintf(topic_cmd_log_flush, sizeof(topic_cmd_log_flush), "%s/cmd/log_flush", base);
+        snprintf(topic_cmd_result, sizeof(topic_cmd_result), "%s/cmd/result", base);
+        snprintf(topic_set_log_level, sizeof(topic_set_log_level), "%s/set/log_level", base);
     }
 
+    /* already running: esp-mqtt reconnects by itself after a Wi-Fi drop */
+    if (client) return;
+
+    session_bits = xEventGroupCreateStatic(&session_bits_buf);
+    pool_free = xSemaphoreCreateCountingStatic(MQTT_POOL_SLOTS, MQTT_POOL_SLOTS, &pool_free_buf);
+    cmd_worker_start(&cmd_ops);
+
     config_data_t cfg = config_get();
 
-    char broker_uri[128] = {0};
+    char broker_addr[64] = {0};
 
     /* Check host validity */
     if (cfg.mqtt_host[0] == '\0')
@@ -322,12 +1434,23 @@ void start_mqtt(void)
         return;
     }
 
-    snprintf(broker_uri, sizeof(broker_uri), "mqtt://%s", cfg.mqtt_host);
+    /*
+     * Connect straight to the cached IPv4 when possible (no DNS on wake).
+     * Otherwise esp-mqtt resolves the hostname in its own task: this runs in
+     * the Wi-Fi event task and must not block on DNS.
+     */
+    if (!broker_cache_lookup(cfg.mqtt_host, broker_addr, sizeof(broker_addr))) {
+        strlcpy(broker_addr, cfg.mqtt_host, sizeof(broker_addr));
+    }
 
     esp_mqtt_client_config_t mqtt_cfg =
     {
         .broker = {
-            .address.uri = broker_uri
+            .address = {
+                .hostname = broker_addr,
+                .port = cfg.mqtt_port > 0 ? cfg.mqtt_port : 1883,
+                .transport = MQTT_TRANSPORT_OVER_TCP,
+            },
         },
         .credentials = {
             .username = cfg.mqtt_user,
@@ -337,17 +1460,32 @@ void start_mqtt(void)
         },
         .session = {
             .keepalive = 30,
+            /* sent by the broker if the device drops without a DISCONNECT */
+            .last_will = {
+                .topic = topic_availability,
+                .msg = AVAIL_OFFLINE,
+                .qos = 1,
+                .retain = 1,
+            },
+        },
+        .buffer = {
+            .size = MQTT_BUF_IN,
+            .out_size = MQTT_BUF_OUT,
+        },
+        .task = {
+            .stack_size = MQTT_TASK_STACK,
         },
         .network = {
             .disable_auto_reconnect = false,
+            /* jittered so a fleet doesn't hammer the broker in lockstep after an outage */
+            .reconnect_timeout_ms = 5000 + (int)(esp_random() % 5000),
+        },
+        .outbox = {
+            .limit = MQTT_OUTBOX_LIMIT,
         },
     };
-    ESP_LOGI(TAG, "MQTT config:");
-    ESP_LOGI(TAG, "  URI: %s", mqtt_cfg.broker.address.uri);
-    ESP_LOGI(TAG, "  Username: %s", mqtt_cfg.credentials.username ? mqtt_cfg.credentials.username : "(none)");
-    ESP_LOGI(TAG, "  Password: %s", mqtt_cfg.credentials.authentication.password ? mqtt_cfg.credentials.authentication.password : "(none)");
-    ESP_LOGI(TAG, "  Keepalive: %d", mqtt_cfg.session.keepalive);
-    ESP_LOGI(TAG, "  Disable auto reconnect: %s", mqtt_cfg.network.disable_auto_reconnect ? "true" : "false");
+    ESP_LOGI(TAG, "MQTT broker %s:%" PRIu32 " (%s), user '%s'", mqtt_cfg.broker.address.hostname,
+             mqtt_cfg.broker.address.port, cfg.mqtt_host, cfg.mqtt_user);
     client = esp_mqtt_client_init(&mqtt_cfg);
     if (!client) {
         ESP_LOGE(TAG, "Failed to init MQTT client");
@@ -358,14 +1496,323 @@ void start_mqtt(void)
     esp_mqtt_client_start(client);
 }
 
+/**
+ * @brief Wait until the client is connected to the broker
+ * @details Once connected, fills the broker address cache for the next wake.
+ * @param timeout_ms Maximum wait
+ * @return true if connected
+ */
+bool mqtt_wait_connected(uint32_t timeout_ms)
+{
+    if (!session_bits) return false;
+    bool ok = xEventGroupWaitBits(session_bits, SESSION_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                  pdMS_TO_TICKS(timeout_ms)) & SESSION_CONNECTED_BIT;
+    if (ok) {
+        /* caller's task, not the event task: the lookup may block (cache hit in lwIP here) */
+        config_data_t cfg = config_get();
+        broker_cache_refresh(cfg.mqtt_host);
+    }
+    return ok;
+}
+
+/**
+ * @brief Wait until every QoS1 publish has been acknowledged
+ * @param timeout_ms Maximum wait
+ * @return true if nothing is left in flight or in the pool
+ */
+bool mqtt_wait_idle(uint32_t timeout_ms)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (inflight || pool_count) {
+        if (esp_timer_get_time() >= end) return false;
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    return true;
+}
+
+/**
+ * @brief Announce deep sleep and close the session cleanly
+ * @details Publishes "sleeping" (retained) on the availability topic, waits
+ *          for its PUBACK and stops the client, which sends DISCONNECT: the
+ *          broker then discards the last will, so "offline" is only seen for
+ *          devices that vanish.
+ * @param timeout_ms Maximum wait for pending acknowledgements
+ */
+void mqtt_sleep(uint32_t timeout_ms)
+{
+    if (!client || !mqtt_wait_connected(0)) return;
+    mqtt_pub(topic_availability, AVAIL_SLEEPING, 0, 1, true);
+    mqtt_wait_idle(timeout_ms);
+    mqtt_closing = true;
+    esp_mqtt_client_stop(client);
+}
+
+/**
+ * @brief Usage of the publish pool in this wake (high-water marks, drops)
+ */
+void mqtt_pool_get_stats(mqtt_pool_stats_t *out)
+{
+    *out = pool_stats;
+    out->slots = MQTT_POOL_SLOTS;
+    out->inflight_max = MQTT_MAX_INFLIGHT;
+}
+
+/**
+ * @brief Publish the once-per-wake session burst
+ * @details Discovery, previous wake diagnostics, log flush if an error is
+ *          pending and retained echoes of all settings. Runs in the caller's
+ *          task (not the MQTT task), so the publish pool can apply
+ *          backpressure while PUBACKs come in.
+ */
+void mqtt_publish_session(void)
+{
+    if (!client || session_published) return;
+    session_published = true;
+
+    mqtt_publish_discovery();
+    mqtt_publish_wake_trace();
+    mqtt_publish_latency_summary();
+    mqtt_publish_log(false);
+
+    /* publish current settings (retain) */
+    config_data_t c = config_get();
+    for (int t = 0; t < CMD_SETTINGS_END; t++) {
+        mqtt_publish_setting_state((cmd_type_t)t, &c);
+    }
+}
+
+/** @brief expire_after in the last published discovery, -1 = not published yet */
+static int64_t disc_expire_sent = -1;
+
+static uint32_t disc_expire_after_s(void);
+
+/**
+ * @brief Publish the battery policy tier with every reading
+ * @details In connected mode the session burst runs once, but the tier is
+ *          recomputed at every reading and has expire_after. The discovery is
+ *          sent again if the expire_after it carries no longer matches the
+ *          interval (sleep_interval, policy or trend changed).
+ */
+void mqtt_publish_policy(void)
+{
+    if (!client) return;
+    if (disc_expire_sent >= 0 && disc_expire_sent != disc_expire_after_s()) {
+        ESP_LOGI(TAG, "Report interval changed, refreshing discovery");
+        mqtt_publish_discovery();
+    }
+    mqtt_pub(topic_policy_tier, sleep_policy_tier_name(sleep_policy_tier()), 0, 1, true);
+}
+
+/**
+ * @brief Room for the runtime part of a per-entity discovery payload
+ * @details "~" base topic, unique_id, availability, expire_after and device
+ *          block with three copies of the device ID (about 200 B); every table
+ *          entry is checked at build time.
+ */
+#define DISC_FIXED_MAX 240
+#define DISC_FITS(comp, obj, uid, exp, fields) \
+    _Static_assert(sizeof(fields) + sizeof(#uid) + DISC_FIXED_MAX <= MQTT_POOL_PAYLOAD, \
+                   "discovery payload too long: " #obj);
+DISCOVERY_ENTITIES(DISC_FITS)
+
+/** @brief Device-level discovery payload (too large for a pool slot, sent directly) */
+static char disc_device_buf[DISC_DEVICE_MAX];
+
+/** @brief Payloads for moving retained discovery configs between modes */
+static const char disc_migrate[] = "{\"migrate_discovery\":true}";
+
+/**
+ * @brief Append a string to a discovery payload, bounded by @p cap
+ * @details Sizes are checked at build time, so truncation cannot happen with
+ *          an 8 character device ID.
+ */
+static size_t disc_put(char *buf, size_t n, size_t cap, const char *s)
+{
+    size_t len = strlen(s);
+    if (n + len > cap) len = cap - n;
+    memcpy(buf + n, s, len);
+    return n + len;
+}
+
+/**
+ * @brief expire_after for entities refreshed on every wake
+ * @details A reading is stale after DISC_EXPIRE_WAKES radio wakes without it,
+ *          plus a margin for a slow connect. Derived from the current interval
+ *          and battery policy, so it follows sleep_interval changes on the next
+ *          discovery. 0 when the device never sleeps (no expiry).
+ */
+#define DISC_EXPIRE_WAKES    2
+#define DISC_EXPIRE_MARGIN_S 120
+static uint32_t disc_expire_after_s(void)
+{
+    uint64_t s = sleep_policy_report_s();
+    if (s == 0) return 0;
+    s = s * DISC_EXPIRE_WAKES + DISC_EXPIRE_MARGIN_S;
+    return s > INT32_MAX ? INT32_MAX : (uint32_t)s;
+}
+
+/**
+ * @brief Append the device block shared by both discovery modes
+ */
+static size_t disc_put_device(char *buf, size_t n, size_t cap)
+{
+    n = disc_put(buf, n, cap, "\"dev\":{\"ids\":[\"");
+    n = disc_put(buf, n, cap, device_id);
+    n = disc_put(buf, n, cap, "\"],\"name\":\"SoilSensor ");
+    n = disc_put(buf, n, cap, device_id);
+    return disc_put(buf, n, cap, "\",\"mf\":\"rikyru\",\"mdl\":\"ESP32-C3 SoilSensor\"}");
+}
+
+/**
+ * @brief Publish one retained config per table entry
+ * @param payload NULL for the entity configs, otherwise a fixed payload sent
+ *        to every entity topic (migration marker or "" to delete)
+ * @details Each config is streamed straight into a publish pool slot: "~"
+ *          base topic, the entity fields (a compile-time literal),
+ *          availability, expire_after, unique_id and the device block.
+ * @return false if a config could not be queued
+ */
+static bool mqtt_publish_discovery_entities(const char *payload)
+{
+    char exp[24] = "";
+    uint32_t expire_s = disc_expire_after_s();
+    if (expire_s) snprintf(exp, sizeof(exp), ",\"exp_aft\":%" PRIu32, expire_s);
+    if (!payload) disc_expire_sent = expire_s;
+
+    TickType_t wait = (xTaskGetCurrentTaskHandle() == mqtt_task) ? 0 : pdMS_TO_TICKS(MQTT_POOL_WAIT_MS);
+    for (size_t i = 0; i < sizeof(disc_entities) / sizeof(disc_entities[0]); i++) {
+        const disc_entity_t *e = &disc_entities[i];
+        mqtt_slot_t *s = mqtt_pool_reserve(wait);
+        if (!s) {
+            ESP_LOGW(TAG, "Publish pool full, dropped discovery for %s", e->object);
+            return false;
+        }
+
+        snprintf(s->topic, sizeof(s->topic), "homeassistant/%s/soil_%s_%s/config",
+                 e->component, device_id, e->object);
+        size_t n;
+        if (payload) {
+            n = disc_put(s->data, 0, MQTT_POOL_PAYLOAD, payload);
+        } else {
+            n = disc_put(s->data, 0, MQTT_POOL_PAYLOAD, "{\"~\":\"");
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, base);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, "\",");
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, e->fields);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, ",\"avty_t\":\"~/availability\"");
+            if (e->expires) n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, exp);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, ",\"uniq_id\":\"");
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, device_id);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, "_");
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, e->unique);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, "\",");
+            n = disc_put_device(s->data, n, MQTT_POOL_PAYLOAD);
+            n = disc_put(s->data, n, MQTT_POOL_PAYLOAD, "}");
+        }
+        mqtt_pool_commit(s, n, 1, true);
+    }
+    return true;
+}
+
+/**
+ * @brief Publish a retained payload on homeassistant/device/soil_<id>/config
+ * @param payload NULL for the consolidated device config, otherwise a fixed
+ *        payload (migration marker or "" to delete)
+ * @details The device config declares every table entry under "cmps" and
+ *          shares "~", availability, device and origin, so one retained message replaces one
+ *          per entity. It is larger than a pool slot: it is sent directly,
+ *          never queued, once earlier publishes have been acknowledged.
+ * @return false if the message was not handed to esp-mqtt
+ */
+static bool mqtt_publish_discovery_device(const char *payload)
+{
+    char topic[64];
+    snprintf(topic, sizeof(topic), "homeassistant/device/soil_%s/config", device_id);
+    if (payload) return mqtt_pub(topic, payload, 0, 1, true) >= 0;
+
+    char exp[24] = "";
+    uint32_t expire_s = disc_expire_after_s();
+    if (expire_s) snprintf(exp, sizeof(exp), ",\"exp_aft\":%" PRIu32, expire_s);
+    disc_expire_sent = expire_s;
+
+    const size_t cap = sizeof(disc_device_buf);
+    char *b = disc_device_buf;
+    size_t n = disc_put(b, 0, cap, "{\"~\":\"");
+    n = disc_put(b, n, cap, base);
+    n = disc_put(b, n, cap, "\",\"avty_t\":\"~/availability\",");
+    n = disc_put_device(b, n, cap);
+    n = disc_put(b, n, cap, ",\"o\":{\"name\":\"soil_sensor\",\"sw\":\"");
+    n = disc_put(b, n, cap, esp_app_get_description()->version);
+    n = disc_put(b, n, cap, "\"},\"cmps\":{");
+    for (size_t i = 0; i < sizeof(disc_entities) / sizeof(disc_entities[0]); i++) {
+        const disc_entity_t *e = &disc_entities[i];
+        if (i) n = disc_put(b, n, cap, ",");
+        n = disc_put(b, n, cap, "\"");
+        n = disc_put(b, n, cap, e->unique);
+        n = disc_put(b, n, cap, "\":{\"p\":\"");
+        n = disc_put(b, n, cap, e->component);
+        n = disc_put(b, n, cap, "\",");
+        n = disc_put(b, n, cap, e->fields);
+        if (e->expires) n = disc_put(b, n, cap, exp);
+        n = disc_put(b, n, cap, ",\"uniq_id\":\"");
+        n = disc_put(b, n, cap, device_id);
+        n = disc_put(b, n, cap, "_");
+        n = disc_put(b, n, cap, e->unique);
+        n = disc_put(b, n, cap, "\"}");
+    }
+    n = disc_put(b, n, cap, "},\"qos\":1}");
+
+    if (!mqtt_wait_idle(MQTT_POOL_WAIT_MS)) {
+        ESP_LOGW(TAG, "Publishes still pending, device discovery not sent");
+        return false;
+    }
+    return mqtt_pub_direct(topic, b, (int)n, true) >= 0;
+}
+
+/**
+ * @brief Move the retained discovery configs to the other mode
+ * @details Home Assistant migration sequence: mark the old configs with
+ *          migrate_discovery, publish the new ones, then delete the old
+ *          retained messages. Entities keep their unique_id (and history).
+ *          The old configs are deleted only once the broker has acknowledged
+ *          every new one; otherwise the old configs are published again and
+ *          nothing is deleted.
+ * @return false if the switch was aborted (old mode still in place)
+ */
+static bool mqtt_discovery_switch(uint8_t mode)
+{
+    ESP_LOGI(TAG, "Switching discovery to %s mode", mode == DISC_MODE_DEVICE ? "device" : "entity");
+    bool to_device = mode == DISC_MODE_DEVICE;
+
+    portENTER_CRITICAL(&pool_lock);
+    uint32_t dropped = pool_stats.dropped;
+    portEXIT_CRITICAL(&pool_lock);
+
+    bool ok = to_device ? mqtt_publish_discovery_entities(disc_migrate) && mqtt_publish_discovery_device(NULL)
+                        : mqtt_publish_discovery_device(disc_migrate) && mqtt_publish_discovery_entities(NULL);
+    /* acked, not just queued: nothing dropped or expired meanwhile */
+    ok = ok && mqtt_wait_idle(MQTT_POOL_WAIT_MS);
+    portENTER_CRITICAL(&pool_lock);
+    ok = ok && pool_stats.dropped == dropped;
+    portEXIT_CRITICAL(&pool_lock);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "New discovery configs not acknowledged, keeping %s mode", to_device ? "entity" : "device");
+        if (to_device) mqtt_publish_discovery_entities(NULL);
+        else           mqtt_publish_discovery_device(NULL);
+        return false;
+    }
+    if (to_device) mqtt_publish_discovery_entities("");
+    else           mqtt_publish_discovery_device("");
+    return true;
+}
+
 /**
  * @brief Publish HomeAssistant MQTT discovery messages
- * @details Sends device and sensor configuration for HomeAssistant auto-discovery:
- *          - Humidity sensor configuration
- *          - Battery voltage sensor configuration
- *          - Battery percentage sensor configuration
- *          - Sleep interval control configuration
- *          - Number entities for calibration (batt_v_min/max, soil wet/dry raw)
+ * @details One retained config per entry of DISCOVERY_ENTITIES
+ *          (discovery_entities.h): measurements, diagnostics from the health
+ *          JSON, number/select entities for the settings and the calibration
+ *          buttons. With disc_mode = device the same entities go out as a
+ *          single device-level config (Home Assistant 2024.11 or later).
  * @note Messages are published with retain flag set to true
  */
 void mqtt_publish_discovery(void)
@@ -375,204 +1822,119 @@ void mqtt_publish_discovery(void)
         return;
     }
 
-    char discovery_topic[160];
-    char payload[600];
-
-    /* HUMIDITY (%) */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Soil Humidity\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"%%\","
-            "\"device_class\":\"humidity\","
-            "\"unique_id\":\"%s_humidity\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"],"
-                "\"name\":\"SoilSensor %s\","
-                "\"manufacturer\":\"rikyru\","
-                "\"model\":\"ESP32-C3 SoilSensor\""
-            "}"
-        "}", topic_humidity, device_id, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/sensor/soil_%s_humidity/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* BATTERY VOLTAGE (V) */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Battery Voltage\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"V\","
-            "\"device_class\":\"voltage\","
-            "\"unique_id\":\"%s_battery\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"],"
-                "\"name\":\"SoilSensor %s\","
-                "\"manufacturer\":\"rikyru\","
-                "\"model\":\"ESP32-C3 SoilSensor\""
-            "}"
-        "}", topic_battery, device_id, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/sensor/soil_%s_battery/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* BATTERY % */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Battery %%\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"%%\","
-            "\"device_class\":\"battery\","
-            "\"unique_id\":\"%s_battery_pct\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"],"
-                "\"name\":\"SoilSensor %s\","
-                "\"manufacturer\":\"rikyru\","
-                "\"model\":\"ESP32-C3 SoilSensor\""
-            "}"
-        "}", topic_battery_pct, device_id, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/sensor/soil_%s_battery_pct/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* NUMBER: Sleep Interval */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Sleep Interval\","
-            "\"command_topic\":\"%s\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"min\","
-            "\"min\":0,\"max\":1440,\"step\":1,"
-            "\"mode\":\"box\","
-            "\"retain\":true,"
-            "\"unique_id\":\"%s_sleep_interval\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"],"
-                "\"name\":\"SoilSensor %s\","
-                "\"manufacturer\":\"rikyru\","
-                "\"model\":\"ESP32-C3 SoilSensor\""
-            "}"
-        "}", topic_set, topic_sleep, device_id, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/number/soil_%s_sleep_interval/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* NUMBER: Batt Vmin */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Batt Vmin\","
-            "\"command_topic\":\"%s\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"V\","
-            "\"min\":2.5,\"max\":5.5,\"step\":0.01,"
-            "\"mode\":\"box\","
-            "\"retain\":true,"
-            "\"unique_id\":\"%s_batt_v_min\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"]"
-            "}"
-        "}", topic_set_vmin, topic_batt_vmin_state, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/number/soil_%s_batt_vmin/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* NUMBER: Batt Vmax */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Batt Vmax\","
-            "\"command_topic\":\"%s\","
-            "\"state_topic\":\"%s\","
-            "\"unit_of_measurement\":\"V\","
-            "\"min\":2.5,\"max\":5.5,\"step\":0.01,"
-            "\"mode\":\"box\","
-            "\"retain\":true,"
-            "\"unique_id\":\"%s_batt_v_max\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"]"
-            "}"
-        "}", topic_set_vmax, topic_batt_vmax_state, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/number/soil_%s_batt_vmax/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    /* NUMBER: Soil wet/dry RAW */
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Soil Wet RAW\","
-            "\"command_topic\":\"%s\","
-            "\"state_topic\":\"%s\","
-            "\"min\":0,\"max\":4095,\"step\":1,"
-            "\"mode\":\"box\","
-            "\"retain\":true,"
-            "\"unique_id\":\"%s_soil_wet_raw\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"]"
-            "}"
-        "}", topic_set_wet, topic_soil_wet_state, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/number/soil_%s_wet_raw/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    snprintf(payload, sizeof(payload),
-        "{"
-            "\"name\":\"Soil Dry RAW\","
-            "\"command_topic\":\"%s\","
-            "\"state_topic\":\"%s\","
-            "\"min\":0,\"max\":4095,\"step\":1,"
-            "\"mode\":\"box\","
-            "\"retain\":true,"
-            "\"unique_id\":\"%s_soil_dry_raw\","
-            "\"device\":{"
-                "\"identifiers\":[\"%s\"]"
-            "}"
-        "}", topic_set_dry, topic_soil_dry_state, device_id, device_id);
-
-    snprintf(discovery_topic, sizeof(discovery_topic),
-        "homeassistant/number/soil_%s_dry_raw/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    // Button: Segna Bagnato
-    snprintf(payload, sizeof(payload),
-    "{"
-        "\"name\":\"Segna Bagnato\","
-        "\"command_topic\":\"%s\","
-        "\"payload_press\":\"1\","
-        "\"unique_id\":\"%s_soil_mark_wet\","
-        "\"device\":{\"identifiers\":[\"%s\"]}"
-    "}", topic_cmd_mark_wet, device_id, device_id);
-    snprintf(discovery_topic, sizeof(discovery_topic),
-    "homeassistant/button/soil_%s_mark_wet/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
-
-    // Button: Segna Asciutto
-    snprintf(payload, sizeof(payload),
-    "{"
-        "\"name\":\"Segna Asciutto\","
-        "\"command_topic\":\"%s\","
-        "\"payload_press\":\"1\","
-        "\"unique_id\":\"%s_soil_mark_dry\","
-        "\"device\":{\"identifiers\":[\"%s\"]}"
-    "}", topic_cmd_mark_dry, device_id, device_id);
-    snprintf(discovery_topic, sizeof(discovery_topic),
-    "homeassistant/button/soil_%s_mark_dry/config", device_id);
-    esp_mqtt_client_publish(client, discovery_topic, payload, 0, 1, true);
+    if (config_get().disc_mode == DISC_MODE_DEVICE) {
+        mqtt_publish_discovery_device(NULL);
+    } else {
+        mqtt_publish_discovery_entities(NULL);
+    }
+}
+
+/**
+ * @brief Publish the previous wake-cycle timeline
+ * @details Sends the compact phase timeline ("rom=..,boot=..,main=..,...,sleep=.."
+ *          in ms; rom is the scheduled wake slot to esp_timer start, the phases
+ *          are relative to that) recorded in RTC memory before the last deep
+ *          sleep, plus the total awake time. Nothing is sent after a cold boot.
+ */
+void mqtt_publish_wake_trace(void)
+{
+    if (!client || !wake_trace_prev_valid()) return;
+
+    char buf[160];
+    wake_trace_format_prev(buf, sizeof(buf));
+    mqtt_pub(topic_diag_timeline, buf, 0, 0, false);
+
+    snprintf(buf, sizeof(buf), "%" PRIu32, wake_trace_prev_awake_ms());
+    mqtt_pub(topic_awake_ms, buf, 0, 0, false);
+}
+
+/**
+ * @brief Publish the device health diagnostics when due
+ * @details Sends the health JSON (reset/wake cause, counters, heap, task stack
+ *          high-water marks, RSSI/channel/TX power, retries, firmware) retained on
+ *          soil_sensor/<id>/diag every health_every wakes and after any reset.
+ */
+void mqtt_publish_health(void)
+{
+    if (!client || !health_due(config_get().health_every)) return;
+
+    char buf[512];
+    health_format_json(buf, sizeof(buf));
+    mqtt_pub(topic_diag_health, buf, 0, 1, true);
+}
+
+/**
+ * @brief Flush the RTC log ring to the diag/log topic
+ * @param force Flush even if no error was logged since the last flush
+ * @details Records are sent oldest first in chunks of whole lines; a chunk that
+ *          cannot be queued stays lost, the ring is not refilled.
+ */
+void mqtt_publish_log(bool force)
+{
+    if (!client || (!force && !log_ring_has_error())) return;
+
+    char buf[512];
+    unsigned dropped = log_ring_take_dropped();
+    if (dropped) {
+        snprintf(buf, sizeof(buf), "(%u older records dropped)", dropped);
+        mqtt_pub(topic_diag_log, buf, 0, 1, false);
+    }
+
+    size_t n;
+    while ((n = log_ring_read(buf, sizeof(buf))) > 0) {
+        mqtt_pub(topic_diag_log, buf, (int)n, 1, false);
+    }
+}
+
+/**
+ * @brief Publish the latency histogram summary once per configured period
+ * @details When hist_period_h hours have elapsed since the last summary, sends
+ *          sample count, p50/p95/p99 and log2 buckets for Wi-Fi association,
+ *          DHCP, MQTT connect and PUBACK latency, then resets the histograms.
+ */
+void mqtt_publish_latency_summary(void)
+{
+    if (!client || !latency_hist_flush_due(config_get().hist_period_h)) return;
+
+    char buf[640];
+    latency_hist_format(buf, sizeof(buf));
+    if (mqtt_pub(topic_diag_latency, buf, 0, 1, false) >= 0) {
+        latency_hist_reset();
+    }
+}
+
+/**
+ * @brief Publish energy model estimates
+ * @param batt_pct Current battery percentage, used for the days-remaining projection
+ * @details Publishes estimated consumption (mAh/day) and, once enough time has been
+ *          accounted, the projected battery life in days.
+ */
+void mqtt_publish_energy(uint8_t batt_pct)
+{
+    if (!client) return;
+
+    uint32_t per_day = energy_mah_per_day_x100();
+    if (per_day == 0) return;
 
+    char msg[16];
+    snprintf(msg, sizeof(msg), "%" PRIu32 ".%02" PRIu32, per_day / 100, per_day % 100);
+    mqtt_pub(topic_energy_mah_day, msg, 0, 1, false);
+
+    int32_t days = energy_days_remaining(batt_pct);
+    if (days >= 0) {
+        snprintf(msg, sizeof(msg), "%" PRIi32, days);
+        mqtt_pub(topic_batt_days_left, msg, 0, 1, false);
+    }
 }
 
 /**
  * @brief Publish sensor readings to MQTT broker
- * @param humidity Current soil humidity reading in percentage
- * @param battery_voltage Current battery voltage reading in volts
- * @details Publishes humidity, battery voltage, and battery percentage
+ * @param humidity_pm Current soil humidity in per-mille (published as % with one decimal)
+ * @param battery_mv Current battery voltage in millivolts (published as V with two decimals)
+ * @details Publishes humidity, battery voltage, and battery percentage, plus a
+ *          JSON reading carrying the epoch timestamp and time-quality flag
  */
-void mqtt_publish_sensor_data(float humidity, float battery_voltage)
+void mqtt_publish_sensor_data(int humidity_pm, int battery_mv)
 {
     if (!client) {
         ESP_LOGW(TAG, "MQTT client not initialized");
@@ -580,17 +1942,25 @@ void mqtt_publish_sensor_data(float humidity, float battery_voltage)
     }
 
     char hum_str[16];
-    snprintf(hum_str, sizeof(hum_str), "%.1f", humidity);
+    fixed_format(hum_str, sizeof(hum_str), humidity_pm, 1, 1);
 
     char bat_str[16];
-    snprintf(bat_str, sizeof(bat_str), "%.2f", battery_voltage);
+    fixed_format(bat_str, sizeof(bat_str), battery_mv, 3, 2);
 
     char bpct_str[8];
-    snprintf(bpct_str, sizeof(bpct_str), "%u", batt_percent_from_v(battery_voltage));
-
-    esp_mqtt_client_publish(client, topic_humidity, hum_str, 0, 1, false);
-    esp_mqtt_client_publish(client, topic_battery,  bat_str, 0, 1, false);
-    esp_mqtt_client_publish(client, topic_battery_pct, bpct_str, 0, 1, false);
+    snprintf(bpct_str, sizeof(bpct_str), "%u", batt_percent_from_mv(battery_mv));
+
+    /* same reading with epoch timestamp and time quality (no extra radio round trip) */
+    uint64_t epoch_us;
+    time_quality_t tq = rtc_clock_epoch_us(&epoch_us);
+    char reading[96];
+    snprintf(reading, sizeof(reading), "{\"ts\":%" PRIu32 ",\"tq\":%d,\"h\":%s,\"v\":%s}",
+             (uint32_t)(epoch_us / 1000000ULL), (int)tq, hum_str, bat_str);
+    mqtt_pub(topic_reading, reading, 0, 1, false);
+
+    mqtt_pub_tracked(topic_humidity, hum_str, 0, 1, false, 0);
+    mqtt_pub_tracked(topic_battery,  bat_str, 0, 1, false, 1);
+    mqtt_pub_tracked(topic_battery_pct, bpct_str, 0, 1, false, 2);
 
     ESP_LOGI(TAG, "Published humidity: %s to topic: %s", hum_str, topic_humidity);
     ESP_LOGI(TAG, "Published battery: %s to topic: %s", bat_str, topic_battery);
@@ -1,8 +1,31 @@
 #ifndef MQTT_WRAPPER_H
 #define MQTT_WRAPPER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Publish pool usage (see mqtt_pool_get_stats) */
+typedef struct {
+    uint8_t slots;          /**< pool size */
+    uint8_t slots_hw;       /**< most slots waiting at once */
+    uint8_t inflight_max;   /**< cap on unacknowledged QoS1 publishes */
+    uint8_t inflight_hw;    /**< most unacknowledged at once */
+    uint16_t dropped;       /**< publishes dropped (pool full or rejected) */
+} mqtt_pool_stats_t;
+
 void start_mqtt(void);
-void mqtt_publish_sensor_data(float humidity, float battery_voltage);
+bool mqtt_wait_connected(uint32_t timeout_ms);
+bool mqtt_wait_idle(uint32_t timeout_ms);
+void mqtt_sleep(uint32_t timeout_ms);
+void mqtt_publish_session(void);
+void mqtt_publish_policy(void);
+void mqtt_pool_get_stats(mqtt_pool_stats_t *out);
+void mqtt_publish_sensor_data(int humidity_pm, int battery_mv);
 void mqtt_publish_discovery(void);
+void mqtt_publish_wake_trace(void);
+void mqtt_publish_latency_summary(void);
+void mqtt_publish_energy(uint8_t batt_pct);
+void mqtt_publish_log(bool force);
+void mqtt_publish_health(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+// rtc_clock.c
+
+#include "rtc_clock.h"
+#include "esp_private/esp_clk.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include <inttypes.h>
+
+#define TAG "RTCCLK"
+
+#define RTC_CLOCK_MAGIC      0xC10C0033u
+// riferimenti troppo vicini danno una stima dominata dal jitter SNTP
+#define DRIFT_MIN_SPAN_US    (3600ULL * 1000000ULL)
+// oltre questo valore la misura è considerata errata (RC interno: ~±5%)
+#define DRIFT_MAX_PPM        60000
+
+typedef struct {
+    uint32_t magic;
+    uint64_t ref_rtc_us;     // rtc_clock_now_us() al riferimento usato per la deriva
+    uint64_t ref_epoch_us;   // tempo vero allo stesso riferimento
+    uint64_t wall_rtc_us;    // ultimo riferimento (orologio assoluto)
+    uint64_t wall_epoch_us;
+    int32_t  drift_ppm;
+    bool     drift_valid;
+} rtc_discipline_t;
+
+static RTC_DATA_ATTR rtc_discipline_t disc;
+static bool synced_this_wake = false;
+
+uint64_t rtc_clock_now_us(void)
+{
+    // richiede CONFIG_ESP_TIME_FUNCS_USE_RTC_TIMER (attivo in sdkconfig)
+    return esp_clk_rtc_time();
+}
+
+void rtc_clock_discipline(uint64_t epoch_us)
+{
+    uint64_t now = rtc_clock_now_us();
+
+    if (disc.magic == RTC_CLOCK_MAGIC) {
+        disc.wall_rtc_us = now;
+        disc.wall_epoch_us = epoch_us;
+        synced_this_wake = true;
+    }
+
+    if (disc.magic == RTC_CLOCK_MAGIC && epoch_us > disc.ref_epoch_us) {
+        uint64_t true_span = epoch_us - disc.ref_epoch_us;
+        if (true_span < DRIFT_MIN_SPAN_US) return;  // si tiene il riferimento più vecchio
+
+        int64_t err = (int64_t)(now - disc.ref_rtc_us) - (int64_t)true_span;
+        int64_t ppm = err * 1000000LL / (int64_t)true_span;
+        if (ppm > -DRIFT_MAX_PPM && ppm < DRIFT_MAX_PPM) {
+            // media mobile: la deriva varia lentamente con la temperatura
+            disc.drift_ppm = disc.drift_valid ? (int32_t)((disc.drift_ppm * 3 + ppm) / 4) : (int32_t)ppm;
+            disc.drift_valid = true;
+            ESP_LOGI(TAG, "RTC drift %" PRIi32 " ppm (filtered %" PRIi32 ")", (int32_t)ppm, disc.drift_ppm);
+        } else {
+            ESP_LOGW(TAG, "Discarding implausible drift %" PRIi32 " ppm", (int32_t)ppm);
+        }
+    } else if (disc.magic != RTC_CLOCK_MAGIC) {
+        disc.drift_valid = false;
+        disc.drift_ppm = 0;
+    }
+
+    disc.ref_rtc_us = now;
+    disc.ref_epoch_us = epoch_us;
+    disc.wall_rtc_us = now;
+    disc.wall_epoch_us = epoch_us;
+    disc.magic = RTC_CLOCK_MAGIC;
+    synced_this_wake = true;
+}
+
+bool rtc_clock_drift_known(void)
+{
+    return disc.magic == RTC_CLOCK_MAGIC && disc.drift_valid;
+}
+
+int32_t rtc_clock_drift_ppm(void)
+{
+    return rtc_clock_drift_known() ? disc.drift_ppm : 0;
+}
+
+uint64_t rtc_clock_true_to_rtc_us(uint64_t true_us)
+{
+    int64_t ppm = rtc_clock_drift_ppm();
+    return (uint64_t)((int64_t)true_us + (int64_t)true_us / 1000000LL * ppm +
+                      ((int64_t)(true_us % 1000000ULL) * ppm) / 1000000LL);
+}
+
+uint64_t rtc_clock_rtc_to_true_us(uint64_t rtc_us)
+{
+    // diviso in quoziente e resto per non andare in overflow su intervalli lunghi
+    uint64_t div = (uint64_t)(1000000LL + rtc_clock_drift_ppm());
+    return (rtc_us / div) * 1000000ULL + (rtc_us % div) * 1000000ULL / div;
+}
+
+time_quality_t rtc_clock_epoch_us(uint64_t *epoch_us)
+{
+    if (disc.magic != RTC_CLOCK_MAGIC || disc.wall_epoch_us == 0) {
+        *epoch_us = 0;
+        return TIME_Q_NONE;
+    }
+
+    uint64_t now = rtc_clock_now_us();
+    uint64_t elapsed = now > disc.wall_rtc_us ? now - disc.wall_rtc_us : 0;
+    *epoch_us = disc.wall_epoch_us + rtc_clock_rtc_to_true_us(elapsed);
+
+    if (synced_this_wake) return TIME_Q_SNTP;
+    return disc.drift_valid ? TIME_Q_RTC_CORRECTED : TIME_Q_RTC;
+}
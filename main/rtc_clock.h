@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Tempo monotono in microsecondi basato sul timer RTC:
+// continua a contare durante il deep sleep (si azzera solo al power-on).
+uint64_t rtc_clock_now_us(void);
+
+// Riferimento di tempo vero (es. SNTP): aggiorna la stima della deriva
+// del clock lento RTC confrontando due riferimenti successivi.
+void rtc_clock_discipline(uint64_t epoch_us);
+
+// true se esiste una stima della deriva
+bool rtc_clock_drift_known(void);
+
+// deriva stimata in ppm (positivo = RTC veloce)
+int32_t rtc_clock_drift_ppm(void);
+
+// converte una durata vera in microsecondi RTC (da passare al timer di sleep)
+uint64_t rtc_clock_true_to_rtc_us(uint64_t true_us);
+
+// converte una durata RTC in tempo vero (corregge la deriva)
+uint64_t rtc_clock_rtc_to_true_us(uint64_t rtc_us);
+
+// Qualità del tempo assoluto
+typedef enum {
+    TIME_Q_NONE = 0,     // mai sincronizzato dal power-on
+    TIME_Q_RTC,          // portato avanti dal timer RTC, deriva non ancora misurata
+    TIME_Q_RTC_CORRECTED,// portato avanti dal timer RTC con correzione della deriva
+    TIME_Q_SNTP,         // sincronizzato via SNTP in questo risveglio
+} time_quality_t;
+
+// tempo assoluto (epoch, us) mantenuto attraverso il deep sleep
+time_quality_t rtc_clock_epoch_us(uint64_t *epoch_us);
@@ -6,28 +6,49 @@
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "config.h"
-#include <math.h>
+#include "esp_timer.h"
 
 
 #define TAG "SENSOR"
 
 // Pin A0 della XIAO ESP32-C3 = GPIO0 = ADC_CHANNEL_2 (ADC1)
 #define VBAT_ADC_CHANNEL ADC_CHANNEL_2
-#define VBAT_DIVIDER_RATIO 2.0  // per partitore 220k/220k
+// partitore 220k/220k: incluso nel fattore di scala (config vbat_scale_q16)
 #define SOIL_ADC_CHANNEL ADC_CHANNEL_3  // GPIO3
 #define SOIL_POWER_GPIO  GPIO_NUM_10    // D10
 
-static float clamp01(float x){ if (x<0) return 0; if (x>1) return 1; return x; }
-static float map01(float x, float a, float b)
+static adc_oneshot_unit_handle_t adc_handle;
+
+// da connesso battery_task e i comandi mark_wet/mark_dry possono leggere insieme:
+// alimentazione della sonda, ADC e contatori passano da qui
+static StaticSemaphore_t sensor_lock_buf;
+static SemaphoreHandle_t sensor_lock;
+
+// tempo totale di alimentazione della sonda in questo risveglio (modello energetico)
+static int64_t probe_on_since = 0;
+static uint32_t probe_on_total_us = 0;
+
+static void probe_power(bool on)
 {
-    if (fabsf(b-a) < 1e-6f) return 0.f;
-    return (x - a) / (b - a);
+    gpio_set_level(SOIL_POWER_GPIO, on ? 1 : 0);
+    if (on) {
+        probe_on_since = esp_timer_get_time();
+    } else if (probe_on_since) {
+        probe_on_total_us += (uint32_t)(esp_timer_get_time() - probe_on_since);
+        probe_on_since = 0;
+    }
 }
 
-static adc_oneshot_unit_handle_t adc_handle;
+uint32_t sensor_probe_on_us(void)
+{
+    return probe_on_total_us;
+}
 
 void sensor_init(void) {
+    sensor_lock = xSemaphoreCreateMutexStatic(&sensor_lock_buf);
+
     adc_oneshot_unit_init_cfg_t init_cfg = {
         .unit_id = ADC_UNIT_1,
     };
@@ -58,108 +79,81 @@ void sensor_init(void) {
     ESP_ERROR_CHECK(adc_oneshot_config_channel(adc_handle, SOIL_ADC_CHANNEL, &soil_chan_cfg ));
 }
 
-float read_battery_voltage(void) {
+int read_battery_mv(void) {
     int raw = 0;
+    xSemaphoreTake(sensor_lock, portMAX_DELAY);
     esp_err_t err = adc_oneshot_read(adc_handle, VBAT_ADC_CHANNEL, &raw);
+    xSemaphoreGive(sensor_lock);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "ADC read failed: %s", esp_err_to_name(err));
-        return -1.0f;
+        return -1;
     }
 
-    float voltage = (raw / 4095.0f) * 3.3f * VBAT_DIVIDER_RATIO;
-    ESP_LOGI(TAG, "Battery raw: %d -> %.2f V", raw, voltage);
-    return voltage;
+    config_data_t c = config_get();
+    int mv = (int)(((uint32_t)raw * c.vbat_scale_q16 + 32768u) >> 16) + c.vbat_offset_mv;
+    if (mv < 0) mv = 0;
+    ESP_LOGI(TAG, "Battery raw: %d -> %d mV", raw, mv);
+    return mv;
 }
 
+uint8_t batt_percent_from_mv(int mv)
+{
+    config_data_t c = config_get();
+    if (c.batt_mv_max <= c.batt_mv_min || mv <= c.batt_mv_min) return 0;
+    if (mv >= c.batt_mv_max) return 100;
+    int span = c.batt_mv_max - c.batt_mv_min;
+    return (uint8_t)(((mv - c.batt_mv_min) * 100 + span / 2) / span);
+}
 
-// float read_soil_moisture(void) {
-//     // Accendi il sensore
-//     gpio_set_level(SOIL_POWER_GPIO, 1);
-//     vTaskDelay(pdMS_TO_TICKS(1500));  // attesa stabilizzazione
-
-//     int raw = 0;
-//     esp_err_t err;// adc_oneshot_read(adc_handle, SOIL_ADC_CHANNEL, &raw);
-//     float sum = 0;
-//     for (int i=0; i<10; i++) 
-//     {
-//         err  = adc_oneshot_read(adc_handle, SOIL_ADC_CHANNEL, &raw);
-//         sum += raw;
-//         vTaskDelay(pdMS_TO_TICKS(80));  // piccolo ritardo tra letture
-//     }
-//     float average = sum / 10.0f;
-
-//     // Spegni il sensore
-//     gpio_set_level(SOIL_POWER_GPIO, 0);
-
-//     if (err != ESP_OK) {
-//         ESP_LOGE(TAG, "ADC read failed for moisture: %s", esp_err_to_name(err));
-//         return -1.0f;
-//     }
-
-//     // Mappatura: più bagnato = valore più basso
-//     float moisture_percent = 100.0f - ((average / 4095.0f) * 100.0f);
-//     ESP_LOGI(TAG, "Moisture raw: %f -> %.1f %%", average, moisture_percent);
-//     return moisture_percent;
-// }
-
-float read_soil_moisture(void) {
-    // Accendi il sensore e attendi stabilizzazione
-    gpio_set_level(SOIL_POWER_GPIO, 1);
-    vTaskDelay(pdMS_TO_TICKS(1500));
-
-    int raw = 0;
-    esp_err_t err = ESP_OK;
-    int sum = 0;
-
-    // Stesso schema di campionamento che avevi (10 campioni con 80 ms)
-    for (int i = 0; i < 10; i++) {
-        err = adc_oneshot_read(adc_handle, SOIL_ADC_CHANNEL, &raw);
-        if (err != ESP_OK) break;
-        sum += raw;
-        vTaskDelay(pdMS_TO_TICKS(80));
-    }
-
-    // Spegni il sensore
-    gpio_set_level(SOIL_POWER_GPIO, 0);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ADC read failed for moisture: %s", esp_err_to_name(err));
-        return -1.0f;
-    }
-
-    // Media arrotondata
-    int avg = (sum + 5) / 10;
-
-    // Mappatura con calibrazione da NVS:
-    // 0% = asciutto (soil_dry_raw), 100% = bagnato (soil_wet_raw),
-    // funziona anche se wet < dry (verso invertito)
+// Mappatura con calibrazione da NVS:
+// 0 = asciutto (soil_dry_raw), 1000 = bagnato (soil_wet_raw),
+// funziona anche se wet < dry (verso invertito)
+int soil_pm_from_raw(int raw)
+{
     config_data_t c = config_get();
-    float p;
+    int pm;
 
     if (c.soil_wet_raw != c.soil_dry_raw) {
-        p = ((float)avg - (float)c.soil_dry_raw) /
-            ((float)c.soil_wet_raw - (float)c.soil_dry_raw);
+        int span = (int)c.soil_wet_raw - (int)c.soil_dry_raw;
+        int num = (raw - (int)c.soil_dry_raw) * 1000;
+        // divisione arrotondata anche con span o numeratore negativi
+        pm = (num >= 0) == (span > 0) ? (num + span / 2) / span : (num - span / 2) / span;
     } else {
         // Fallback legacy se non calibrato
-        p = 1.0f - ((float)avg / 4095.0f);
+        pm = 1000 - (raw * 1000 + 2047) / 4095;
     }
 
-    // Clamp 0..1
-    if (p < 0.0f) p = 0.0f;
-    if (p > 1.0f) p = 1.0f;
+    if (pm < 0) pm = 0;
+    if (pm > 1000) pm = 1000;
+    return pm;
+}
 
-    float moisture_percent = p * 100.0f;
-    ESP_LOGI(TAG, "Moisture raw:%d -> %.1f%% (dry:%u wet:%u)",
-             avg, moisture_percent, c.soil_dry_raw, c.soil_wet_raw);
+uint8_t soil_percent_from_raw(int raw)
+{
+    return (uint8_t)((soil_pm_from_raw(raw) + 5) / 10);
+}
 
-    return moisture_percent;
+int read_soil_moisture_pm(void) {
+    int avg = sensor_read_soil_raw_avg();
+    if (avg < 0) {
+        ESP_LOGE(TAG, "ADC read failed for moisture");
+        return -1;
+    }
+
+    int pm = soil_pm_from_raw(avg);
+    config_data_t c = config_get();
+    ESP_LOGI(TAG, "Moisture raw:%d -> %d pm (dry:%u wet:%u)",
+             avg, pm, c.soil_dry_raw, c.soil_wet_raw);
+    return pm;
 }
+
 /*
 READ AVG MOISTURE
 */
 int sensor_read_soil_raw_avg(void) {
+    xSemaphoreTake(sensor_lock, portMAX_DELAY);
     // accendi
-    gpio_set_level(SOIL_POWER_GPIO, 1);
+    probe_power(true);
     vTaskDelay(pdMS_TO_TICKS(1500));
 
     int raw = 0, sum = 0;
@@ -171,7 +165,8 @@ int sensor_read_soil_raw_avg(void) {
         vTaskDelay(pdMS_TO_TICKS(80));
     }
     // spegni
-    gpio_set_level(SOIL_POWER_GPIO, 0);
+    probe_power(false);
+    xSemaphoreGive(sensor_lock);
 
     if (err != ESP_OK) return -1;
     return (sum + 5) / 10;
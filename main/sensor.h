@@ -2,10 +2,13 @@
 #include <stdint.h>
 
 void sensor_init(void);
-float read_battery_voltage(void);
-float read_soil_moisture(void);
+// Letture intere: mV e umidità in per-mille (0 = asciutto, 1000 = bagnato), -1 = errore ADC
+int read_battery_mv(void);
+int read_soil_moisture_pm(void);
 
 
-uint8_t  batt_percent_from_v(float v); // 0–100
+uint8_t  batt_percent_from_mv(int mv);  // 0–100
 uint8_t  soil_percent_from_raw(int raw);// 0–100
+int      soil_pm_from_raw(int raw);     // 0–1000
 int sensor_read_soil_raw_avg(void);
+uint32_t sensor_probe_on_us(void);   // tempo sonda alimentata in questo risveglio
@@ -0,0 +1,21 @@
+// setting_owner.c
+// Precedenza tra comandi set/*, set retained e documenti di configurazione.
+
+#include "setting_owner.h"
+
+bool setting_owner_accept(setting_origin_t from, uint32_t bit, uint32_t local_mask, uint32_t fleet_mask)
+{
+    switch (from) {
+        case SETTING_FROM_FLEET_DOC:
+            return !(local_mask & bit);
+        case SETTING_FROM_RETAINED:
+            return (local_mask & bit) || !(fleet_mask & bit);
+        default:
+            return true;
+    }
+}
+
+bool setting_owner_pins(setting_origin_t from)
+{
+    return from == SETTING_FROM_COMMAND || from == SETTING_FROM_DEVICE_DOC;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Chi decide un'impostazione (un bit per CMD_SET_*): il dispositivo stesso
+// (local_mask in config) oppure un documento di flotta all/group (fleet_mask,
+// ricalcolato a ogni applicazione dei documenti).
+
+typedef enum {
+    SETTING_FROM_COMMAND = 0,  // set/* ricevuto dal vivo
+    SETTING_FROM_RETAINED,     // set/* retained riconsegnato alla connessione
+    SETTING_FROM_DEVICE_DOC,   // config/desired del dispositivo
+    SETTING_FROM_FLEET_DOC,    // documento all o group
+} setting_origin_t;
+
+// true se il valore va applicato. Un set retained può essere più vecchio
+// dell'ultimo documento di flotta: se il documento possiede l'impostazione
+// (e non è fissata sul dispositivo) vince il documento.
+bool setting_owner_accept(setting_origin_t from, uint32_t bit, uint32_t local_mask, uint32_t fleet_mask);
+
+// true se un cambio da questa origine fissa l'impostazione sul dispositivo
+// (i documenti di flotta non la cambiano più). Né i documenti di flotta né i
+// set retained la fissano: non si sa se sono più recenti del documento.
+bool setting_owner_pins(setting_origin_t from);
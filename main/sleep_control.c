@@ -1,19 +1,301 @@
 #include "esp_sleep.h"
 #include "esp_log.h"
+#include "esp_attr.h"
 #include <inttypes.h>
 #include "config.h"
+#include "sleep_control.h"
+#include "wake_trace.h"
+#include "energy.h"
+#include "moisture_trend.h"
+#include "rtc_clock.h"
+#include "wake_stub.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #define TAG "SLEEP"
 
-void enter_deep_sleep()
+// con sleep disabilitato (0) il livello critico dorme comunque con questa base
+#define CRITICAL_BASE_MINUTES 60
+
+static sleep_tier_t tier = SLEEP_TIER_NORMAL;
+static uint32_t stretch_x100 = 100;   // fattore di allungamento x100
+
+// prossimo risveglio in tempo RTC assoluto (0 = nessuna griglia, es. dopo power-on)
+static RTC_DATA_ATTR uint64_t next_wake_rtc_us = 0;
+
+// sotto questo margine lo slot è considerato perso e si passa al successivo
+#define MIN_SLEEP_US (2ULL * 1000000ULL)
+
+// da connesso con sleep disabilitato (sleep_minutes = 0): una lettura al minuto
+#define CONN_ALWAYS_ON_S     60
+// oltre questo intervallo il deep sleep resta comunque (modello poco affidabile)
+#define CONN_MAX_INTERVAL_S  600
+// isteresi sul confronto dei costi: evita di alternare le modalità
+#define CONN_HYSTERESIS_PCT  10
+// costo di un risveglio finché non ne è stato misurato uno: ~3 s di radio
+#define CONN_DEFAULT_WAKE_MS 3000
+
+// dopo power-on/brownout la prima associazione è ritardata di slot % questa finestra
+#define POWER_ON_SPREAD_S    30
+
+static bool connected_mode = false;
+static TickType_t conn_last_tick;
+static int64_t conn_last_us;
+
+void sleep_policy_update(int vbat_mv)
+{
+    config_data_t c = config_get();
+    tier = SLEEP_TIER_NORMAL;
+    stretch_x100 = 100;
+
+    if (vbat_mv <= 0) return;  // lettura non valida: nessuna penalità
+
+    int v_mv = vbat_mv;
+    int min_mv = c.batt_mv_min;
+    int stretch_mv = min_mv + c.pol_stretch_mv;
+    int crit_mv = min_mv + c.pol_crit_mv;
+    uint32_t max_x100 = (uint32_t)c.pol_max_factor * 100;
+
+    if (v_mv < crit_mv) {
+        tier = SLEEP_TIER_CRITICAL;
+        stretch_x100 = max_x100;
+    } else if (v_mv < stretch_mv && stretch_mv > crit_mv) {
+        // lineare: 1x a stretch_mv, max_factor a crit_mv
+        tier = SLEEP_TIER_STRETCH;
+        stretch_x100 = 100 + (max_x100 - 100) * (uint32_t)(stretch_mv - v_mv) / (uint32_t)(stretch_mv - crit_mv);
+    }
+
+    ESP_LOGI(TAG, "Battery %d mV -> tier %s, interval x%" PRIu32 ".%02" PRIu32,
+             v_mv, sleep_policy_tier_name(tier), stretch_x100 / 100, stretch_x100 % 100);
+}
+
+sleep_tier_t sleep_policy_tier(void)
+{
+    return tier;
+}
+
+const char *sleep_policy_tier_name(sleep_tier_t t)
+{
+    switch (t) {
+        case SLEEP_TIER_STRETCH:  return "stretch";
+        case SLEEP_TIER_CRITICAL: return "critical";
+        default:                  return "normal";
+    }
+}
+
+// Risvegli da far gestire al wake stub prima del prossimo boot completo.
+// In critico i risvegli senza radio non arrivano più all'applicazione:
+// ogni boot completo è già l'heartbeat.
+static uint32_t stub_skip_cycles(void)
 {
+    config_data_t c = config_get();
+    if (tier == SLEEP_TIER_CRITICAL) {
+        return c.pol_heartbeat_every > 1 ? c.pol_heartbeat_every - 1u : 0;
+    }
+    return c.stub_skip;
+}
 
+uint32_t sleep_policy_interval_s(void)
+{
     int mins = config_get().sleep_minutes;
-    if (mins > 0) {
-        ESP_LOGI("SLEEP", "Going to deep sleep for %d min", mins);
-        esp_sleep_enable_timer_wakeup((uint64_t)mins * 60 * 1000000ULL);
+    if (mins <= 0) {
+        if (tier != SLEEP_TIER_CRITICAL) return 0;
+        mins = CRITICAL_BASE_MINUTES;
+    }
+
+    // base: previsione dalla tendenza dell'umidità, se attiva e con dati sufficienti
+    uint32_t base_s = moisture_trend_next_s();
+    if (base_s == 0) base_s = (uint32_t)mins * 60;
+
+    return (uint32_t)((uint64_t)base_s * stretch_x100 / 100);
+}
+
+uint32_t sleep_policy_report_s(void)
+{
+    config_data_t c = config_get();
+    int mins = c.sleep_minutes;
+    if (mins <= 0) {
+        if (tier != SLEEP_TIER_CRITICAL) return 0;
+        mins = CRITICAL_BASE_MINUTES;
+    }
+    // la tendenza può allungare l'intervallo fino a trend_max_minutes
+    if (c.trend_enabled && c.trend_max_minutes > mins) mins = c.trend_max_minutes;
+
+    uint64_t s = (uint64_t)mins * 60 * stretch_x100 / 100 * (stub_skip_cycles() + 1);
+    return s > UINT32_MAX ? UINT32_MAX : (uint32_t)s;
+}
+
+// Offset del dispositivo nella griglia: distribuisce i risvegli della flotta
+// sull'intervallo invece di farli coincidere (es. dopo un blackout).
+static uint32_t slot_offset_s(uint32_t interval_s)
+{
+    int32_t slot = config_get().wake_slot_s;
+    if (slot >= 0) return (uint32_t)slot % interval_s;
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        h ^= mac[i];
+        h *= 16777619u;
+    }
+    return h % interval_s;
+}
+
+void sleep_power_on_spread(void)
+{
+    esp_reset_reason_t r = esp_reset_reason();
+    // ritorno della corrente o calo di tensione: tutta la flotta riparte insieme
+    if (r != ESP_RST_POWERON && r != ESP_RST_BROWNOUT) return;
+
+    uint32_t delay_s = slot_offset_s(POWER_ON_SPREAD_S);
+    if (delay_s == 0) return;
+    ESP_LOGI(TAG, "Power-on: first connect in %" PRIu32 " s", delay_s);
+    vTaskDelay(pdMS_TO_TICKS(delay_s * 1000));
+}
+
+uint64_t sleep_wake_slot_rtc_us(void)
+{
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) return 0;
+    if (wake_stub_skipped() > 0) return 0;  // riarmato dallo stub: slot spostato
+    return next_wake_rtc_us;
+}
+
+void sleep_schedule_reset(void)
+{
+    next_wake_rtc_us = 0;
+}
+
+// Durata dello sleep fino al prossimo slot della griglia: il tempo passato
+// sveglio viene sottratto e l'intervallo corretto per la deriva RTC misurata.
+static uint64_t schedule_next_wake_us(uint32_t interval_s)
+{
+    uint64_t now = rtc_clock_now_us();
+    uint64_t step = rtc_clock_true_to_rtc_us((uint64_t)interval_s * 1000000ULL);
+
+    uint64_t target;
+    if (next_wake_rtc_us) {
+        target = next_wake_rtc_us + step;
+    } else {
+        // nuova griglia: il primo risveglio cade nello slot del dispositivo
+        target = now + rtc_clock_true_to_rtc_us((uint64_t)slot_offset_s(interval_s) * 1000000ULL);
+    }
+    if (target < now + MIN_SLEEP_US) {
+        // slot persi (risveglio lungo o intervallo ridotto): salta al primo utile
+        uint64_t missed = (now + MIN_SLEEP_US - target) / step + 1;
+        target += missed * step;
+    }
+    if (target > now + 2 * step) {
+        // griglia non più coerente (es. intervallo ridotto di molto): riparte da ora
+        target = now + step;
+    }
+
+    next_wake_rtc_us = target;
+    return target - now;
+}
+
+// configurazione radio/CPU da connesso; false = default (modem sleep minimo, niente light sleep)
+static void connected_power_save(bool on)
+{
+    esp_wifi_set_ps(on ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = on ? 40 : CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .light_sleep_enable = on,
+    };
+    if (esp_pm_configure(&pm) != ESP_OK && on) ESP_LOGW(TAG, "Automatic light sleep not available");
+#endif
+}
+
+bool sleep_stay_connected(void)
+{
+    config_data_t c = config_get();
+    bool stay;
+    if (c.conn_mode == CONN_MODE_OFF || tier != SLEEP_TIER_NORMAL) {
+        stay = false;  // la policy batteria ha la precedenza
+    } else if (c.conn_mode == CONN_MODE_ON || c.sleep_minutes <= 0) {
+        // sleep disabilitato: niente deep sleep da confrontare, meglio il power save
+        // che il ciclo sempre sveglio (una lettura ogni CONN_ALWAYS_ON_S)
+        stay = true;
+    } else if (c.stub_skip) {
+        stay = false;  // i risvegli del wake stub costano già quasi niente
+    } else {
+        // costo di un intervallo: risveglio + deep sleep contro corrente da associato
+        uint32_t interval = sleep_policy_interval_s();
+        uint64_t wake = energy_wake_uas();
+        if (wake == 0) wake = (uint64_t)c.e_radio_ua * CONN_DEFAULT_WAKE_MS / 1000;
+        uint64_t deep = wake + (uint64_t)c.e_sleep_ua * interval;
+        uint64_t conn = (uint64_t)c.e_conn_ua * interval;
+        // per cambiare modalità l'altra deve costare almeno CONN_HYSTERESIS_PCT in meno
+        if (connected_mode) stay = conn * 100 <= deep * (100 + CONN_HYSTERESIS_PCT);
+        else                stay = conn * (100 + CONN_HYSTERESIS_PCT) <= deep * 100;
+        stay = stay && interval <= CONN_MAX_INTERVAL_S;
+    }
+
+    if (stay != connected_mode) {
+        ESP_LOGI(TAG, "%s (wake cost %" PRIu32 " uAs)",
+                 stay ? "Staying connected between readings" : "Leaving connected mode", energy_wake_uas());
+    }
+    if (!stay && connected_mode) {
+        // il chiamante va in deep sleep, o con sleep disabilitato resta sveglio come prima
+        connected_mode = false;
+        connected_power_save(false);
+    }
+    return stay;
+}
+
+void sleep_connected_wait(void)
+{
+    if (!connected_mode) {
+        connected_mode = true;
+        // al ritorno al deep sleep la griglia riparte dallo slot del dispositivo
+        sleep_schedule_reset();
+        // la radio si sveglia ogni listen_interval beacon, la CPU va in light sleep tra l'uno e l'altro
+        connected_power_save(true);
+        conn_last_tick = xTaskGetTickCount();
+        conn_last_us = esp_timer_get_time();
+    }
+
+    uint32_t secs = sleep_policy_interval_s();
+    if (secs == 0) secs = CONN_ALWAYS_ON_S;
+    ESP_LOGI(TAG, "Connected sleep for %" PRIu32 " s", secs);
+    vTaskDelayUntil(&conn_last_tick, pdMS_TO_TICKS((uint64_t)secs * 1000));
+
+    int64_t now = esp_timer_get_time();
+    energy_on_connected((uint64_t)(now - conn_last_us));
+    conn_last_us = now;
+}
+
+void enter_deep_sleep()
+{
+    uint32_t secs = sleep_policy_interval_s();
+    if (secs > 0) {
+        uint32_t skip = stub_skip_cycles();
+        if (skip) {
+            ESP_LOGI(TAG, "Wake stub handles the next %" PRIu32 " wakes", skip);
+        }
+        wake_stub_plan(skip, rtc_clock_true_to_rtc_us((uint64_t)secs * 1000000ULL));
+        energy_on_sleep();  // può scrivere in NVS: prima di fissare la durata
+
+        uint64_t sleep_us = schedule_next_wake_us(secs);
+        ESP_LOGI("SLEEP", "Going to deep sleep for %" PRIu32 " ms (interval %" PRIu32 " s, tier %s, drift %" PRIi32 " ppm)",
+                 (uint32_t)(sleep_us / 1000), secs, sleep_policy_tier_name(tier), rtc_clock_drift_ppm());
+        esp_sleep_enable_timer_wakeup(sleep_us);
+        wake_trace_commit();
+#if CONFIG_SOIL_QUIET_ROM_LOG
+        esp_deep_sleep_disable_rom_logging();
+#endif
         esp_deep_sleep_start();
     } else {
+        next_wake_rtc_us = 0;
+        wake_stub_plan(0, 0);
         ESP_LOGI("SLEEP", "Sleep disabled, staying awake");
     }
 }
@@ -1,4 +1,46 @@
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
 
+// Livelli della policy batteria
+typedef enum {
+    SLEEP_TIER_NORMAL = 0,  // intervallo configurato
+    SLEEP_TIER_STRETCH,     // intervallo allungato avvicinandosi a batt_mv_min
+    SLEEP_TIER_CRITICAL,    // niente radio, solo heartbeat rari (wake stub in mezzo)
+} sleep_tier_t;
 
-void enter_deep_sleep();
\ No newline at end of file
+// Da chiamare con una lettura batteria fatta PRIMA di avviare il Wi-Fi
+// (senza il calo di tensione dovuto al TX)
+void sleep_policy_update(int vbat_mv);
+
+sleep_tier_t sleep_policy_tier(void);
+const char *sleep_policy_tier_name(sleep_tier_t tier);
+
+// intervallo effettivo in secondi (0 = sleep disabilitato)
+uint32_t sleep_policy_interval_s(void);
+
+// distanza massima tra due risvegli con radio con la policy attuale, tenendo
+// conto di tendenza e wake stub (0 = sempre sveglio); base di expire_after
+uint32_t sleep_policy_report_s(void);
+
+// Slot (tempo RTC) per cui era programmato questo risveglio; 0 se il boot
+// non viene da un timer della griglia (power-on, reset, risveglio dello stub)
+uint64_t sleep_wake_slot_rtc_us(void);
+
+// dopo un power-on o un brownout attende lo slot del dispositivo in una finestra
+// breve prima di avviare il Wi-Fi: la flotta non si associa tutta insieme
+void sleep_power_on_spread(void);
+
+// riparte con una nuova griglia di risveglio (es. cambio di slot)
+void sleep_schedule_reset(void);
+
+// true se tra questa lettura e la prossima conviene restare associati
+// (modem sleep + light sleep automatico) invece di rifare Wi-Fi e MQTT dal
+// deep sleep: intervallo breve o nullo, policy batteria normale, costo del
+// risveglio misurato contro la corrente da connesso (config conn_mode)
+bool sleep_stay_connected(void);
+
+// da connesso: attende la prossima lettura in power save e addebita il periodo
+void sleep_connected_wait(void);
+
+void enter_deep_sleep();
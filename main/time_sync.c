@@ -0,0 +1,56 @@
+// time_sync.c
+// SNTP non bloccante, usato solo quando serve un nuovo riferimento di tempo:
+// al cold boot oppure ogni sntp_every risvegli. Negli altri risvegli l'ora
+// viene portata avanti da rtc_clock senza costi radio.
+
+#include "time_sync.h"
+#include "rtc_clock.h"
+#include "config.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include <sys/time.h>
+
+#define TAG "SNTP"
+
+#define SNTP_SERVER          "pool.ntp.org"
+
+static RTC_DATA_ATTR uint32_t wakes_since_sync = 0;
+static bool checked = false;
+static bool started = false;
+static volatile bool done = false;
+
+static void on_sync(struct timeval *tv)
+{
+    uint64_t epoch_us = (uint64_t)tv->tv_sec * 1000000ULL + (uint64_t)tv->tv_usec;
+    rtc_clock_discipline(epoch_us);
+    wakes_since_sync = 0;
+    done = true;
+    ESP_LOGI(TAG, "Time synchronized");
+}
+
+void time_sync_start_if_due(void)
+{
+    if (checked) return;  // una sola decisione per risveglio (GOT_IP può ripetersi)
+    checked = true;
+
+    uint64_t epoch_us;
+    uint16_t every = config_get().sntp_every;
+    wakes_since_sync++;
+    bool due = rtc_clock_epoch_us(&epoch_us) == TIME_Q_NONE ||
+               (every > 0 && wakes_since_sync >= every);
+    if (!due) return;
+
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(SNTP_SERVER);
+    cfg.sync_cb = on_sync;
+    cfg.wait_for_sync = false;
+    if (esp_netif_sntp_init(&cfg) == ESP_OK) {
+        started = true;
+        ESP_LOGI(TAG, "SNTP sync started (%s)", SNTP_SERVER);
+    }
+}
+
+bool time_sync_done(void)
+{
+    return done;
+}
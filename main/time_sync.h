@@ -0,0 +1,9 @@
+#pragma once
+#include <stdbool.h>
+
+// Avvia una sincronizzazione SNTP asincrona se serve (cold boot o ultimo
+// riferimento troppo vecchio); il risultato disciplina rtc_clock.
+void time_sync_start_if_due(void);
+
+// true se in questo risveglio l'SNTP ha già risposto
+bool time_sync_done(void);
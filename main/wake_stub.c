@@ -0,0 +1,54 @@
+// wake_stub.c
+// Tutto ciò che lo stub usa deve stare in RTC (RTC_IRAM_ATTR / RTC_DATA_ATTR):
+// al risveglio la cache della flash non è ancora attiva. Niente divisioni a
+// 64 bit né chiamate a funzioni in flash qui dentro.
+
+#include "wake_stub.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_wake_stub.h"
+#include "sdkconfig.h"
+
+typedef struct {
+    uint32_t skip_remaining;   // risvegli ancora da saltare
+    uint32_t skipped;          // risvegli saltati dall'ultimo boot completo
+    uint32_t total_wakes;
+    uint64_t interval_us;      // intervallo RTC da riarmare
+} wake_stub_state_t;
+
+static RTC_DATA_ATTR wake_stub_state_t stub;
+
+void RTC_IRAM_ATTR esp_wake_deep_sleep(void)
+{
+    stub.total_wakes++;
+
+    if (stub.skip_remaining > 0 && stub.interval_us > 0) {
+        stub.skip_remaining--;
+        stub.skipped++;
+#if CONFIG_SOIL_WAKE_STUB_LOG
+        ESP_RTC_LOGI("stub: tick %u, back to sleep", (unsigned)stub.skipped);
+#endif
+        esp_wake_stub_set_wakeup_time(stub.interval_us);
+        esp_wake_stub_sleep(&esp_wake_deep_sleep);  // non ritorna
+    }
+
+    // serve l'applicazione: boot completo
+    esp_default_wake_deep_sleep();
+}
+
+void wake_stub_plan(uint32_t skip_cycles, uint64_t interval_rtc_us)
+{
+    stub.interval_us = interval_rtc_us;
+    stub.skip_remaining = interval_rtc_us ? skip_cycles : 0;
+    stub.skipped = 0;
+}
+
+uint32_t wake_stub_skipped(void)
+{
+    return stub.skipped;
+}
+
+uint32_t wake_stub_total_wakes(void)
+{
+    return stub.total_wakes;
+}
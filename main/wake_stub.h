@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// Stub di risveglio in RTC fast memory: decide, senza avviare l'applicazione,
+// se un risveglio da timer richiede il boot completo. I risvegli "solo
+// contatore" vengono riarmati e il chip torna in deep sleep in pochi ms.
+
+// Regole per i prossimi risvegli: saltare il boot completo per skip_cycles
+// risvegli consecutivi, ciascuno a interval_rtc_us (tempo RTC) dal precedente.
+// skip_cycles = 0 disattiva lo stub (ogni risveglio fa il boot completo).
+void wake_stub_plan(uint32_t skip_cycles, uint64_t interval_rtc_us);
+
+// risvegli gestiti dallo stub dall'ultimo boot completo
+// (azzerato dal prossimo wake_stub_plan)
+uint32_t wake_stub_skipped(void);
+
+// risvegli totali dal power-on (stub + boot completi)
+uint32_t wake_stub_total_wakes(void);
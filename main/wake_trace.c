@@ -0,0 +1,102 @@
+// wake_trace.c
+// Timeline delle fasi di risveglio, conservata in RTC e pubblicata
+// nella sessione successiva come messaggio diagnostico.
+
+#include "wake_trace.h"
+#include "rtc_clock.h"
+#include "sleep_control.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define WAKE_TRACE_MAGIC 0x7ACE0038u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rom_us;          // slot di risveglio -> avvio esp_timer (0 = non noto)
+    uint32_t t_us[WT_COUNT];
+} wake_timeline_t;
+
+static const char *const phase_names[WT_COUNT] = {
+    "boot", "main", "nvs", "sens", "adc", "wifi", "assoc", "ip", "mqtt", "puback", "sleep",
+};
+
+static uint32_t current[WT_COUNT];
+static uint32_t rom_us;
+static RTC_DATA_ATTR wake_timeline_t prev;
+
+static uint32_t now_us(void)
+{
+    // 0 è riservato a "fase non raggiunta"
+    uint32_t t = (uint32_t)esp_timer_get_time();
+    return t ? t : 1;
+}
+
+// eseguito da do_global_ctors(), prima di app_main
+__attribute__((constructor))
+static void wake_trace_boot(void)
+{
+    current[WT_BOOT] = now_us();
+
+    // esp_timer parte da zero a ogni boot: il tempo di ROM, bootloader e
+    // caricamento immagine si ricava dall'RTC rispetto allo slot programmato
+    uint64_t slot = sleep_wake_slot_rtc_us();
+    uint64_t rtc_now = rtc_clock_now_us();
+    if (slot && rtc_now > slot + current[WT_BOOT]) {
+        uint64_t d = rtc_now - slot - current[WT_BOOT];
+        rom_us = d < UINT32_MAX ? (uint32_t)d : 0;
+    }
+}
+
+void wake_trace_mark(wake_phase_t phase)
+{
+    if (phase >= WT_COUNT) return;
+    if (current[phase] == 0 || phase == WT_LAST_PUBACK) {
+        current[phase] = now_us();
+    }
+}
+
+uint32_t wake_trace_get_us(wake_phase_t phase)
+{
+    return phase < WT_COUNT ? current[phase] : 0;
+}
+
+void wake_trace_commit(void)
+{
+    wake_trace_mark(WT_SLEEP);
+    memcpy(prev.t_us, current, sizeof(prev.t_us));
+    prev.rom_us = rom_us;
+    prev.magic = WAKE_TRACE_MAGIC;
+}
+
+bool wake_trace_prev_valid(void)
+{
+    return prev.magic == WAKE_TRACE_MAGIC;
+}
+
+uint32_t wake_trace_prev_awake_ms(void)
+{
+    return wake_trace_prev_valid() ? prev.t_us[WT_SLEEP] / 1000 : 0;
+}
+
+uint32_t wake_trace_prev_us(wake_phase_t phase)
+{
+    return (wake_trace_prev_valid() && phase < WT_COUNT) ? prev.t_us[phase] : 0;
+}
+
+int wake_trace_format_prev(char *buf, size_t len)
+{
+    if (!wake_trace_prev_valid() || len == 0) return 0;
+
+    size_t n = 0;
+    buf[0] = '\0';
+    if (prev.rom_us) {
+        n += snprintf(buf, len, "rom=%lu,", (unsigned long)(prev.rom_us / 1000));
+    }
+    for (int i = 0; i < WT_COUNT && n < len; i++) {
+        n += snprintf(buf + n, len - n, "%s%s=%lu", i ? "," : "", phase_names[i],
+                      (unsigned long)(prev.t_us[i] / 1000));
+    }
+    return (int)(n < len ? n : len - 1);
+}
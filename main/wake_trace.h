@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Fasi del ciclo di risveglio, in ordine cronologico
+typedef enum {
+    WT_BOOT = 0,        // handoff ROM/bootloader -> app (costruttori globali)
+    WT_APP_MAIN,        // ingresso in app_main
+    WT_NVS_LOADED,      // config caricata da NVS
+    WT_SENSOR_INIT,     // sensor_init() completato
+    WT_ADC_DONE,        // acquisizione ADC (suolo + batteria) completata
+    WT_WIFI_START,      // avvio Wi-Fi
+    WT_WIFI_ASSOC,      // associato all'AP
+    WT_GOT_IP,          // indirizzo IP ottenuto
+    WT_MQTT_CONNECTED,  // sessione MQTT stabilita
+    WT_LAST_PUBACK,     // ultimo PUBACK ricevuto
+    WT_SLEEP,           // ingresso in deep sleep
+    WT_COUNT
+} wake_phase_t;
+
+// Registra il timestamp (esp_timer_get_time) della fase; le fasi vengono
+// registrate solo la prima volta, tranne WT_LAST_PUBACK che si aggiorna.
+void wake_trace_mark(wake_phase_t phase);
+
+// Timestamp della fase nel risveglio corrente in us (0 = non raggiunta)
+uint32_t wake_trace_get_us(wake_phase_t phase);
+
+// Chiude la timeline (WT_SLEEP) e la salva in RTC per la sessione successiva
+void wake_trace_commit(void);
+
+// Timeline del risveglio precedente: true se disponibile
+bool wake_trace_prev_valid(void);
+// Tempo da reset a deep sleep del risveglio precedente
+uint32_t wake_trace_prev_awake_ms(void);
+// Timestamp della fase nel risveglio precedente in us (0 = non raggiunta)
+uint32_t wake_trace_prev_us(wake_phase_t phase);
+// Formato compatto "rom=95,boot=182,main=190,...,sleep=4600": rom è il tempo
+// dallo slot di risveglio all'avvio di esp_timer, le fasi sono ms da lì
+int wake_trace_format_prev(char *buf, size_t len);
@@ -0,0 +1,100 @@
+// wifi_sta.c
+// Connessione STA dell'app di misura: config da NVS, backoff sulle riconnessioni.
+// Il portale di provisioning vive nell'app factory (provisioning/).
+
+#include "wifi_sta.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "config.h"
+#include <string.h>
+#include "ip_cache.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+#define TAG "WIFI"
+
+// backoff esponenziale con jitter per i tentativi di riconnessione
+#define WIFI_BACKOFF_BASE_MS  500
+#define WIFI_BACKOFF_MAX_MS   30000
+static esp_timer_handle_t reconnect_timer = NULL;
+static uint32_t reconnect_attempts = 0;
+
+void wifi_connect_from_config(void) {
+    config_data_t config = config_get();
+    esp_netif_init();
+    esp_event_loop_create_default();
+    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_wifi_init(&cfg);
+    esp_wifi_set_mode(WIFI_MODE_STA);
+
+    wifi_config_t sta_cfg = {0};
+    strcpy((char *)sta_cfg.sta.ssid, config.wifi_ssid);
+    strcpy((char *)sta_cfg.sta.password, config.wifi_pass);
+    // usato solo da connessi in modem sleep (vedi sleep_connected_wait)
+    sta_cfg.sta.listen_interval = config.listen_interval;
+
+    esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_cfg);
+    esp_wifi_start();
+    ip_cache_prepare(sta_netif);
+    esp_wifi_connect();
+
+    ESP_LOGI(TAG, "Connecting to Wi-Fi...");
+}
+
+static void reconnect_timer_cb(void *arg)
+{
+    esp_wifi_connect();
+}
+
+void wifi_reconnect_with_backoff(void)
+{
+    if (reconnect_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = reconnect_timer_cb,
+            .name = "wifi_backoff",
+        };
+        if (esp_timer_create(&args, &reconnect_timer) != ESP_OK) {
+            esp_wifi_connect();
+            return;
+        }
+    }
+
+    // base * 2^n limitato, poi jitter 50..150% per non riconnettere tutti insieme
+    uint32_t shift = reconnect_attempts < 6 ? reconnect_attempts : 6;
+    uint32_t delay_ms = WIFI_BACKOFF_BASE_MS << shift;
+    if (delay_ms > WIFI_BACKOFF_MAX_MS) delay_ms = WIFI_BACKOFF_MAX_MS;
+    delay_ms = delay_ms / 2 + esp_random() % (delay_ms + 1);
+    reconnect_attempts++;
+
+    ESP_LOGI(TAG, "Reconnect attempt %lu in %lu ms", (unsigned long)reconnect_attempts, (unsigned long)delay_ms);
+    esp_timer_stop(reconnect_timer);
+    esp_timer_start_once(reconnect_timer, (uint64_t)delay_ms * 1000ULL);
+}
+
+void wifi_reconnect_reset(void)
+{
+    reconnect_attempts = 0;
+}
+
+uint32_t wifi_reconnect_attempts(void)
+{
+    return reconnect_attempts;
+}
+
+void wifi_boot_provisioning(void)
+{
+    const esp_partition_t *factory = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                              ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+    if (factory == NULL || esp_ota_set_boot_partition(factory) != ESP_OK) {
+        ESP_LOGE(TAG, "Provisioning app not found");
+        return;
+    }
+    ESP_LOGI(TAG, "Rebooting into provisioning app");
+    esp_restart();
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+
+void wifi_connect_from_config(void);
+
+// riconnessione con backoff esponenziale + jitter (evita tempeste di riconnessioni)
+void wifi_reconnect_with_backoff(void);
+void wifi_reconnect_reset(void);
+uint32_t wifi_reconnect_attempts(void);
+
+// riavvia nell'app di provisioning (partizione factory)
+void wifi_boot_provisioning(void);
@@ -0,0 +1,21 @@
+// provisioning/main/app_main.c
+// App factory: solo portale di configurazione (AP + HTTP). Dopo il salvataggio
+// il boot passa all'app di misura in ota_0, che torna qui se la config non è valida.
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "config.h"
+#include "wifi_provisioning.h"
+
+static const char *TAG = "MAIN";
+
+void app_main(void) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ESP_ERROR_CHECK(nvs_flash_init());
+    }
+
+    config_load();  // i campi già salvati restano (es. calibrazione)
+    ESP_LOGI(TAG, "Starting provisioning portal.");
+    start_wifi_provisioning();
+}
@@ -33,6 +33,12 @@ const char *form_html =
 "MQTT Port:<br><input name='mqtt_port' type='number' value='1883'><br>"
 "MQTT User:<br><input name='mqtt_user'><br>"
 "MQTT Password:<br><input name='mqtt_pass' type='password'><br>"
-"Sleep Interval (minutes):<br><input name='sleep_interval' type='number' value='5'><br><br>"
+"Sleep Interval (minutes):<br><input name='sleep_interval' type='number' value='5'><br>"
+"<details><summary>IP statico (opzionale)</summary>"
+"IP:<br><input name='static_ip' placeholder='192.168.1.50'><br>"
+"Gateway:<br><input name='static_gw' placeholder='192.168.1.1'><br>"
+"Netmask:<br><input name='static_mask' value='255.255.255.0'><br>"
+"DNS:<br><input name='static_dns' placeholder='(gateway)'><br>"
+"</details><br>"
 "<input type='submit' value='Save & Reboot'>"
 "</form></body></html>";
@@ -4,10 +4,13 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "config.h"
 #include "form_html.h"
 #include <string.h>
 #include "esp_mac.h"
+#include "esp_ota_ops.h"
 
 #define TAG "PROVISIONING"
 static httpd_handle_t server = NULL;
@@ -25,11 +28,28 @@ static esp_err_t handle_post(httpd_req_t *req) {
     if (ret <= 0) return ESP_FAIL;
     buf[ret] = '\0';
 
-    config_data_t cfg = {0};
+    config_data_t cfg = config_get();  // parte dai default per i campi non presenti nel form
     sscanf(buf, "ssid=%[^&]&password=%[^&]&mqtt_host=%[^&]&mqtt_port=%d&mqtt_user=%[^&]&mqtt_pass=%[^&]&sleep_interval=%d",
            cfg.wifi_ssid, cfg.wifi_pass, cfg.mqtt_host, &cfg.mqtt_port, cfg.mqtt_user, cfg.mqtt_pass, &cfg.sleep_minutes);
 
+    // IP statico opzionale: campi vuoti = DHCP
+    httpd_query_key_value(buf, "static_ip", cfg.static_ip, sizeof(cfg.static_ip));
+    httpd_query_key_value(buf, "static_gw", cfg.static_gw, sizeof(cfg.static_gw));
+    httpd_query_key_value(buf, "static_mask", cfg.static_mask, sizeof(cfg.static_mask));
+    httpd_query_key_value(buf, "static_dns", cfg.static_dns, sizeof(cfg.static_dns));
+
     config_save(&cfg);
+
+    // al riavvio parte l'app di misura (ota_0); se manca si resta qui
+    const esp_partition_t *app = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
+                                                          ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    esp_err_t err = app ? esp_ota_set_boot_partition(app) : ESP_ERR_NOT_FOUND;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "No valid measurement app in ota_0: %s", esp_err_to_name(err));
+        httpd_resp_sendstr(req, "Saved, but no measurement app is flashed.");
+        return ESP_OK;
+    }
+
     httpd_resp_sendstr(req, "Saved. Rebooting...");
     vTaskDelay(pdMS_TO_TICKS(2000));
     esp_restart();
@@ -144,28 +164,3 @@ void start_wifi_provisioning(void) {
     ESP_LOGI(TAG, "Access point started. Connect to '%s' and go to 192.168.4.1", ssid);
     start_http_server();
 }
-
-void wifi_connect_from_config(void) {
-    config_data_t config = config_get();
-    esp_netif_init();
-    esp_event_loop_create_default();
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    esp_wifi_init(&cfg);
-    esp_wifi_set_mode(WIFI_MODE_STA);
-
-    wifi_config_t sta_cfg = {0};
-    strcpy((char *)sta_cfg.sta.ssid, config.wifi_ssid);
-    strcpy((char *)sta_cfg.sta.password, config.wifi_pass);
-
-    esp_wifi_set_config(ESP_IF_WIFI_STA, &sta_cfg);
-    esp_wifi_start();
-    esp_wifi_connect();
-
-    ESP_LOGI(TAG, "Connecting to Wi-Fi...");
-}
-
-
-
-
@@ -1,5 +1,3 @@
 #pragma once
 
 void start_wifi_provisioning(void);
-void wifi_connect_from_config(void);
-
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Report del budget di memoria dell'app di misura.
+
+Dall'ELF (build time): RAM statica per regione (DRAM data/bss, RTC, IRAM)
+e stack statici dei task (simboli *_stack). Dal messaggio diag del sensore
+(runtime, opzionale): heap libero minimo e margine di stack per task.
+
+    cmake --build build --target memory-budget
+    tools/mem_budget.py --elf build/SoilHumSensor.elf --objdump riscv32-esp-elf-objdump \\
+        --nm riscv32-esp-elf-nm --diag diag.json
+
+diag.json è il payload retained di soil_sensor/<id>/diag, ad esempio:
+    mosquitto_sub -h <broker> -t soil_sensor/<id>/diag -C 1 > diag.json
+"""
+import argparse
+import json
+import re
+import subprocess
+
+REGIONS = {
+    "DRAM data": (".dram0.data",),
+    "DRAM bss": (".dram0.bss",),
+    "RTC (data+bss)": (".rtc.data", ".rtc.bss", ".rtc_noinit", ".rtc.force_fast", ".rtc.text"),
+    "IRAM": (".iram0.text", ".iram0.data", ".iram0.bss"),
+}
+
+
+def section_sizes(objdump, elf):
+    out = subprocess.run([objdump, "-h", elf], check=True, capture_output=True, text=True).stdout
+    sizes = {}
+    for line in out.splitlines():
+        m = re.match(r"\s*\d+\s+(\S+)\s+([0-9a-fA-F]+)\s", line)
+        if m:
+            sizes[m.group(1)] = int(m.group(2), 16)
+    return sizes
+
+
+def static_stacks(nm, elf):
+    out = subprocess.run([nm, "-S", "--size-sort", elf], check=True, capture_output=True, text=True).stdout
+    stacks = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 4 and parts[2] in "bBdD" and parts[3].endswith("_task_stack"):
+            stacks[parts[3][:-len("_stack")]] = int(parts[1], 16)
+    return stacks
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--elf", required=True)
+    ap.add_argument("--objdump", default="riscv32-esp-elf-objdump")
+    ap.add_argument("--nm", default="riscv32-esp-elf-nm")
+    ap.add_argument("--diag", help="health JSON published on soil_sensor/<id>/diag")
+    args = ap.parse_args()
+
+    sizes = section_sizes(args.objdump, args.elf)
+    print("Static RAM")
+    total = 0
+    for region, sections in REGIONS.items():
+        n = sum(sizes.get(s, 0) for s in sections)
+        if region.startswith("DRAM"):
+            total += n
+        print(f"  {region:<16} {n:>8} B")
+    print(f"  {'DRAM total':<16} {total:>8} B")
+
+    stacks = static_stacks(args.nm, args.elf)
+    diag = {}
+    if args.diag:
+        with open(args.diag) as f:
+            diag = json.load(f)
+    hwm = diag.get("stack", {})
+
+    print("Task stacks (static)")
+    for task, size in sorted(stacks.items()):
+        short = task[:-len("_task")]
+        free = hwm.get(short)
+        used = f"{size - free:>6} B used, {free} B never touched" if isinstance(free, int) and free >= 0 else "no runtime data"
+        print(f"  {task:<16} {size:>8} B   {used}")
+    for task in sorted(set(hwm) - {t[:-len('_task')] for t in stacks}):
+        if hwm[task] < 0:
+            continue  # task non presente in quel risveglio
+        print(f"  {task:<16} {'(heap)':>8}     {hwm[task]} B never touched")
+
+    if diag:
+        print("Heap (runtime)")
+        print(f"  free now         {diag.get('heap', '?'):>8} B")
+        print(f"  minimum free     {diag.get('heap_min', '?'):>8} B   (peak usage = heap size - minimum free)")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Benchmark del risveglio: raccoglie le timeline pubblicate dal sensore su
+soil_sensor/<id>/diag/timeline e riporta boot->app_main e boot->sleep.
+
+Uso (un profilo alla volta, stesso sensore e stessa rete):
+
+    # profilo debug (sdkconfig del repo), poi release, flashati in ota_0
+    tools/wake_bench.py record --host 192.168.1.10 --id A1B2C3D4 -n 30 -o debug.json
+    tools/wake_bench.py record --host 192.168.1.10 --id A1B2C3D4 -n 30 -o release.json
+    tools/wake_bench.py compare debug.json release.json
+
+"boot" parte dallo slot di risveglio programmato (campo rom= della timeline,
+misurato con il timer RTC), quindi include ROM, bootloader e caricamento
+dell'immagine. Per una misura pulita tenere stub_skip a 0 e sleep_interval
+corto (es. 1 minuto).
+"""
+import argparse
+import json
+import statistics
+import sys
+
+
+def parse_timeline(payload):
+    fields = {}
+    for item in payload.split(","):
+        key, _, value = item.partition("=")
+        if value.isdigit():
+            fields[key] = int(value)
+    if "rom" not in fields or "main" not in fields or "sleep" not in fields:
+        return None  # power-on o risveglio dello stub: slot non noto
+    return {
+        "boot_to_main_ms": fields["rom"] + fields["main"],
+        "boot_to_sleep_ms": fields["rom"] + fields["sleep"],
+    }
+
+
+def record(args):
+    import paho.mqtt.client as mqtt
+
+    topic = f"soil_sensor/{args.id}/diag/timeline"
+    samples = []
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(topic, qos=0)
+        print(f"waiting for {args.samples} wakes on {topic}", file=sys.stderr)
+
+    def on_message(client, userdata, msg):
+        sample = parse_timeline(msg.payload.decode(errors="replace"))
+        if sample is None:
+            return
+        samples.append(sample)
+        print(f"[{len(samples)}/{args.samples}] main {sample['boot_to_main_ms']} ms, "
+              f"sleep {sample['boot_to_sleep_ms']} ms", file=sys.stderr)
+        if len(samples) >= args.samples:
+            client.disconnect()
+
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    client.loop_forever()
+
+    with open(args.output, "w") as f:
+        json.dump(samples, f, indent=1)
+
+
+def summary(samples, key):
+    values = sorted(s[key] for s in samples)
+    p90 = values[min(len(values) - 1, int(len(values) * 0.9))]
+    return statistics.median(values), p90
+
+
+def compare(args):
+    profiles = []
+    for path in args.files:
+        with open(path) as f:
+            profiles.append((path, json.load(f)))
+
+    print(f"{'profile':<20} {'n':>4} {'boot->main med/p90':>20} {'boot->sleep med/p90':>21}")
+    for path, samples in profiles:
+        if not samples:
+            print(f"{path:<20} {0:>4}")
+            continue
+        m_med, m_p90 = summary(samples, "boot_to_main_ms")
+        s_med, s_p90 = summary(samples, "boot_to_sleep_ms")
+        print(f"{path:<20} {len(samples):>4} {m_med:>11.0f} / {m_p90:<6} ms {s_med:>11.0f} / {s_p90:<6} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    rec = sub.add_parser("record", help="collect wake timelines from MQTT")
+    rec.add_argument("--host", required=True)
+    rec.add_argument("--port", type=int, default=1883)
+    rec.add_argument("--user")
+    rec.add_argument("--password")
+    rec.add_argument("--id", required=True, help="device id as in the topics (last 4 MAC bytes)")
+    rec.add_argument("-n", "--samples", type=int, default=30)
+    rec.add_argument("-o", "--output", required=True)
+    rec.set_defaults(func=record)
+
+    cmp_ = sub.add_parser("compare", help="print profiles side by side")
+    cmp_.add_argument("files", nargs="+")
+    cmp_.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Simulazione della flotta: distribuzione delle connessioni al broker per N sensori.
+
+Riproduce sull'host la griglia di risveglio di sleep_control.c (offset per
+dispositivo = FNV-1a del MAC STA modulo l'intervallo, oppure wake_slot
+assegnato) e il backoff Wi-Fi di wifi_sta.c (500 ms << n fino a 30 s, jitter
+50..150%, al massimo 8 tentativi per risveglio), e confronta con il
+comportamento precedente (tutti sugli stessi confini, riconnessione fissa).
+
+    tools/wake_spread.py -n 50 --interval 300
+    tools/wake_spread.py -n 200 --outage 600:90 --max-peak 10
+
+Scenari: accensione contemporanea a t=0 (es. ritorno della corrente) e,
+con --outage START:DURATA, AP spento per DURATA secondi da START.
+Dopo l'accensione la prima connessione attende lo slot del dispositivo
+modulo POWER_ON_SPREAD_S (sleep_power_on_spread()); il picco per secondo
+comprende anche questa raffica. Con --max-peak esce con errore se il picco
+con la griglia supera il limite (uso come test).
+"""
+import argparse
+import random
+import sys
+
+BACKOFF_BASE_MS = 500       # WIFI_BACKOFF_BASE_MS
+BACKOFF_MAX_MS = 30000      # WIFI_BACKOFF_MAX_MS
+MAX_RECONNECTS = 8          # WIFI_MAX_RECONNECTS
+MIN_SLEEP_S = 2             # MIN_SLEEP_US
+POWER_ON_SPREAD_S = 30      # POWER_ON_SPREAD_S
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def fleet_macs(n, rng):
+    # stesso lotto di produzione: MAC consecutivi, il caso peggiore per l'hash
+    base = rng.getrandbits(24)
+    return [bytes([0x24, 0x0A, 0xC4]) + ((base + i) & 0xFFFFFF).to_bytes(3, "big") for i in range(n)]
+
+
+def backoff_s(attempt, jitter, rng):
+    delay = min(BACKOFF_BASE_MS << min(attempt, 6), BACKOFF_MAX_MS)
+    if jitter:
+        delay = delay // 2 + rng.randint(0, delay)
+    return delay / 1000
+
+
+def connect(t, outage, jitter, rng):
+    """Istante della connessione riuscita per un risveglio a t, None se rinuncia."""
+    start, end = outage
+    attempt = 0
+    while start <= t < end:
+        if attempt >= MAX_RECONNECTS:
+            return None
+        t += backoff_s(attempt, jitter, rng)
+        attempt += 1
+    return t
+
+
+def simulate(macs, args, spread, rng):
+    outage = args.outage or (-1, -1)
+    events = []   # (istante, prima connessione dopo l'accensione)
+    for i, mac in enumerate(macs):
+        if args.slots:
+            slot = i * args.interval // len(macs)
+        else:
+            slot = fnv1a(mac)
+        offset = slot % args.interval
+        t = rng.uniform(0, args.boot_jitter)   # accensione contemporanea
+        if spread:
+            t += slot % POWER_ON_SPREAD_S
+        grid = None
+        first = True
+        while t < args.duration:
+            c = connect(t, outage, spread, rng)
+            if c is not None:
+                events.append((c, first))
+            first = False
+            now = (c if c is not None else t) + args.awake
+            if not spread:
+                t = now + args.interval
+                continue
+            # schedule_next_wake_us(): primo risveglio nello slot, poi griglia fissa
+            target = grid + args.interval if grid is not None else now + offset
+            if target < now + MIN_SLEEP_S:
+                target += ((now + MIN_SLEEP_S - target) // args.interval + 1) * args.interval
+            grid = target
+            t = target
+    return events
+
+
+def histogram(events, duration, bucket):
+    counts = [0] * (int(duration // bucket) + 1)
+    for t in events:
+        if t < duration:
+            counts[int(t // bucket)] += 1
+    return counts
+
+
+def report(name, events, args):
+    power_on = [t for t, first in events if first]
+    per_s = histogram([t for t, _ in events], args.duration, 1)
+    busy = sorted(c for c in per_s if c)
+    p99 = busy[int(len(busy) * 0.99) - 1] if busy else 0
+    first_peak = max(histogram(power_on, args.duration, 1))
+    print(f"{name}: {len(events)} connections, peak {max(per_s)}/s "
+          f"(power-on {first_peak}/s), p99 {p99}/s over busy seconds")
+    if args.plot:
+        coarse = histogram([t for t, _ in events], args.duration, args.plot)
+        scale = max(1, max(coarse) // 60 + 1)
+        for i, c in enumerate(coarse):
+            if c:
+                print(f"  {i * args.plot:6d}s {c:5d} {'#' * (c // scale or 1)}")
+    return max(per_s)
+
+
+def outage_arg(text):
+    start, sep, length = text.partition(":")
+    try:
+        if not sep:
+            raise ValueError
+        start, length = float(start), float(length)
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"expected START:DURATION in seconds, got {text!r}")
+    if start < 0 or length <= 0:
+        raise argparse.ArgumentTypeError("START must be >= 0 and DURATION > 0")
+    return (start, start + length)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("-n", "--devices", type=int, default=50)
+    ap.add_argument("--interval", type=int, default=300, help="sleep interval (s)")
+    ap.add_argument("--duration", type=int, default=None, help="simulated time (s, default 4 intervals)")
+    ap.add_argument("--awake", type=float, default=3.0, help="time awake per wake (s)")
+    ap.add_argument("--boot-jitter", type=float, default=0.5, help="power-on spread (s)")
+    ap.add_argument("--outage", type=outage_arg, help="AP outage START:DURATION (s)")
+    ap.add_argument("--slots", action="store_true", help="evenly assigned wake_slot instead of the MAC hash")
+    ap.add_argument("--plot", type=int, default=0, metavar="S", help="print a histogram in S-second buckets")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--max-peak", type=int, help="fail if the spread peak (power-on included) exceeds this many per second")
+    args = ap.parse_args()
+    if args.duration is None:
+        args.duration = 4 * args.interval
+
+    macs = fleet_macs(args.devices, random.Random(args.seed))
+    report("lockstep, backoff without jitter", simulate(macs, args, False, random.Random(args.seed)), args)
+    peak = report("wake slots, jittered backoff", simulate(macs, args, True, random.Random(args.seed)), args)
+
+    if args.max_peak is not None and peak > args.max_peak:
+        print(f"FAIL: peak {peak}/s > {args.max_peak}/s")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())